@@ -20,6 +20,7 @@ time emcc src/*.cc src/emulator/*.cc \
     -s DISABLE_EXCEPTION_CATCHING=0 \
     -s PTHREAD_POOL_SIZE=1 \
     --embed-file assets/DejaVuSans.ttf \
+    --embed-file roms/romconfig.txt \
     --embed-file roms/mario.gb \
     --embed-file roms/tetris.gb
 
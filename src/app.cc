@@ -36,6 +36,7 @@ App::App()
     });
 
     romStore_ = std::make_unique<RomStore>();
+    romStore_->LoadConfig("roms/romconfig.txt");
     romStore_->AddFromFile("roms/tetris.gb");
     romStore_->AddFromFile("roms/mario.gb");
 }
@@ -99,6 +100,14 @@ void App::Mainloop()
         mainCalls_ = 0;
         mainTime_ = 0;
         printf("mainloop %0.1f FPS\n", fps);
+
+        if (state_ == AS_EMULATOR) {
+            const SdlSound::Stats stats = sdlHelper_->GetSound().GetStats();
+            printf("Audio fill %zu (avg %.0f, target %zu) rate %+.3f%% drift %+.3f%% underruns %llu overruns %llu\n",
+                stats.fill, stats.averageFill, stats.targetFill,
+                stats.rateAdjust * 100.0, stats.drift * 100.0,
+                (unsigned long long)stats.underruns, (unsigned long long)stats.overruns);
+        }
     }
 
     // Process commands
@@ -189,6 +198,8 @@ void App::StartEmulator(int romId)
 
     emulator_ = new Emulator::Emulator("log.txt", rom->size_, rom->data_, NULL, 
         sdlHelper_->GetDisplayBitmap(), sdlHelper_->GetSound());
+    emulator_->SetRunAhead(runAheadFrames_);
+    emulator_->SetIdleLoopSkipping(rom->idleLoopSkipping_);
 
     const SDL_Rect windowRect = sdlHelper_->GetWindowRect();
 
@@ -47,6 +47,9 @@ public:
 
     void Run();
 
+    // Frames to run ahead to hide input latency, see Emulator::SetRunAhead().
+    void SetRunAhead(int frames) { runAheadFrames_ = frames; }
+
 private:
     static void MainloopWrapper(void *arg);
     void Mainloop();
@@ -71,6 +74,8 @@ private:
 
     std::list<Command> commands_;
 
+    int runAheadFrames_ = 0;
+
     StartUi *startUi_;
 
     Emulator::Emulator *emulator_;
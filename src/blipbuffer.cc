@@ -0,0 +1,113 @@
+#include "blipbuffer.hh"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace GBEmu
+{
+
+namespace
+{
+
+struct Kernel
+{
+	int16_t taps[BlipBuffer::phaseCount_][BlipBuffer::kernelWidth_];
+};
+
+// Blackman windowed sinc, cut off a little below Nyquist. Tap k of phase p
+// is the response at k - delay - p / phases samples from the delta.
+Kernel MakeKernel()
+{
+	const int phases = BlipBuffer::phaseCount_;
+	const int width = BlipBuffer::kernelWidth_;
+	const int delay = BlipBuffer::delay_;
+	const int bits = BlipBuffer::kernelBits_;
+
+	const double pi = 3.14159265358979323846;
+	const double cutoff = 0.9;
+
+	Kernel kernel = {};
+
+	for (int p = 0; p < phases; p++)
+	{
+		double taps[width];
+		double sum = 0;
+
+		for (int k = 0; k < width; k++)
+		{
+			const double t = k - delay - double(p) / phases;
+			const double x = pi * cutoff * t;
+			const double sinc = x ? std::sin(x) / x : 1.0;
+
+			// Window over t in (-width/2, width/2].
+			const double w = (t + width / 2.0) / width;
+			const double window = 0.42 - 0.5 * std::cos(2 * pi * w) + 0.08 * std::cos(4 * pi * w);
+
+			taps[k] = sinc * window;
+			sum += taps[k];
+		}
+
+		// Normalize to exactly 1 << bits, so a step integrates to its
+		// full height without drifting.
+		int total = 0;
+		for (int k = 0; k < width; k++)
+		{
+			kernel.taps[p][k] = static_cast<int16_t>(std::lround(taps[k] / sum * (1 << bits)));
+			total += kernel.taps[p][k];
+		}
+		kernel.taps[p][delay] += static_cast<int16_t>((1 << bits) - total);
+	}
+
+	return kernel;
+}
+
+const Kernel kernel = MakeKernel();
+
+}
+
+BlipBuffer::BlipBuffer(int maxSamples)
+	:maxSamples_(maxSamples),
+	buffer_(maxSamples + kernelWidth_ + 1),
+	integrator_(0)
+{
+	assert(maxSamples > 0);
+}
+
+void BlipBuffer::AddDelta(uint32_t time, int delta)
+{
+	if (!delta) return;
+
+	const uint32_t index = time >> timeBits_;
+	const int phase = (time >> (timeBits_ - phaseBits_)) & (phaseCount_ - 1);
+
+	assert(index < static_cast<uint32_t>(maxSamples_));
+
+	const int16_t * const taps = kernel.taps[phase];
+	int32_t * const out = &buffer_[index];
+
+	for (int k = 0; k < kernelWidth_; k++)
+		out[k] += delta * taps[k];
+}
+
+void BlipBuffer::ReadSamples(int16_t *out, int count)
+{
+	assert(count <= maxSamples_);
+
+	for (int i = 0; i < count; i++)
+	{
+		integrator_ += buffer_[i];
+
+		const int shift = kernelBits_ - outputBits_;
+		const int sample = (integrator_ + (1 << (shift - 1))) >> shift;
+		out[i] = static_cast<int16_t>(std::clamp(sample, -32768, 32767));
+	}
+
+	// Keep the tails of the deltas that reach into the next block.
+	const size_t tail = kernelWidth_ + 1;
+	memmove(&buffer_[0], &buffer_[count], tail * sizeof(int32_t));
+	std::fill(buffer_.begin() + tail, buffer_.begin() + tail + count, 0);
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace GBEmu
+{
+
+// Band-limited synthesis buffer. Instead of samples, sources add the
+// steps of their output level (deltas) at exact fractional sample times.
+// Each delta is spread over a few samples with a windowed-sinc kernel and
+// the output is the running sum of the buffer, so square and stepped
+// waveforms come out without aliasing at a fixed cost per delta,
+// independent of the waveform frequency.
+class BlipBuffer
+{
+public:
+	// Times are fixed point, in 1/2^timeBits_ samples from the start of
+	// the block read by the next ReadSamples() call.
+	static constexpr int timeBits_ = 16;
+
+	explicit BlipBuffer(int maxSamples);
+
+	// All deltas of a block must be added before it is read,
+	// with times before the end of the block.
+	void AddDelta(uint32_t time, int delta);
+
+	// Reads count samples and starts the next block after them. A delta
+	// of 1 is a step of 1 << outputBits_ in the output.
+	void ReadSamples(int16_t *out, int count);
+
+	static constexpr int phaseBits_ = 5;
+	static constexpr int phaseCount_ = 1 << phaseBits_;
+	static constexpr int kernelWidth_ = 16;
+	static constexpr int kernelBits_ = 15; // Every phase sums to 1 << kernelBits_.
+	static constexpr int outputBits_ = 10;
+
+	// The output is delayed by this many samples, the kernel's center.
+	static constexpr int delay_ = 7;
+
+private:
+	const int maxSamples_;
+	std::vector<int32_t> buffer_;
+	int32_t integrator_;
+};
+
+}
\ No newline at end of file
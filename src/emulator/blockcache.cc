@@ -0,0 +1,200 @@
+#include "blockcache.hh"
+#include "memory.hh"
+#include "opcodes.hh"
+
+#include <cassert>
+
+#ifdef GBEMU_BLOCK_CACHE
+
+namespace GBEmu::Emulator
+{
+
+BlockCache::BlockCache(Memory &memory)
+	:memory_(memory),
+	blocks_(groupCount_ * 256, CodeBlock {}),
+	invalidations_({}),
+	block_(nullptr),
+	next_(nullptr),
+	end_(nullptr),
+	uncached_({})
+#ifdef GBEMU_JIT
+	,generation_(0)
+#endif
+{
+	memory_.SetRemapHandler([&]()
+	{
+		ResetCursor();
+#ifdef GBEMU_JIT
+		generation_++;
+#endif
+	});
+	memory_.SetCodeWriteHandler([&](uint8_t page) { InvalidatePage(page); });
+}
+
+const CachedInstruction &BlockCache::FetchSlow(uint16_t pc)
+{
+	// Back at the start of the block, e.g. in a loop?
+	if (!block_ || block_->pc != pc)
+		block_ = Lookup(pc);
+
+	if (block_)
+	{
+		next_ = &block_->instructions[1];
+		end_ = &block_->instructions[block_->count];
+		return block_->instructions[0];
+	}
+
+	return FetchUncached(pc);
+}
+
+const CachedInstruction &BlockCache::FetchUncached(uint16_t pc)
+{
+	// Only the operand bytes the instruction has are read, reads in IO
+	// space may have side effects.
+	ResetCursor();
+
+	uncached_.pc = pc;
+	uncached_.opcode = memory_.Read(pc);
+	uncached_.length = GetInstructionLength(uncached_.opcode);
+	uncached_.operand = 0;
+	if (uncached_.length > 1) uncached_.operand = memory_.Read(pc + 1);
+	if (uncached_.length > 2) uncached_.operand |= memory_.Read(pc + 2) << 8;
+
+	return uncached_;
+}
+
+const CodeBlock *BlockCache::Lookup(uint16_t pc)
+{
+	const uint8_t * const code = memory_.GetReadPointer(pc);
+	if (!code) return nullptr;
+
+	// Blocks of such pages are gone already, no need to look.
+	if (invalidations_[Memory::GetPhysicalPage(pc >> 8)] >= maxInvalidations_) return nullptr;
+
+	CodeBlock &block = blocks_[GetIndex(pc)];
+	if (block.key == code && block.pc == pc && block.count) return &block;
+
+	Decode(block, pc, code);
+
+	// Empty if the first instruction crosses into the next page.
+	return block.count ? &block : nullptr;
+}
+
+void BlockCache::InvalidateRam()
+{
+	for (CodeBlock &block : blocks_)
+	{
+		if (block.pc >= 0x8000)
+			block.count = 0;
+	}
+
+	invalidations_.fill(0);
+	ResetCursor();
+#ifdef GBEMU_JIT
+	generation_++;
+#endif
+}
+
+#ifdef GBEMU_JIT
+void BlockCache::DropNative()
+{
+	for (CodeBlock &block : blocks_)
+		block.native = nullptr;
+}
+#endif
+
+void BlockCache::InvalidatePage(uint8_t page)
+{
+	// Echo RAM pages are handed in as the page they mirror, blocks may
+	// have been decoded through either address.
+	auto invalidate = [&](uint8_t p)
+	{
+		const size_t first = GetIndex(p << 8);
+		for (size_t i = first; i < first + 256; i++)
+		{
+			if ((blocks_[i].pc >> 8) == p)
+				blocks_[i].count = 0;
+		}
+	};
+
+	if (invalidations_[page] < maxInvalidations_)
+		invalidations_[page]++;
+
+	ResetCursor();
+#ifdef GBEMU_JIT
+	generation_++;
+#endif
+
+	invalidate(page);
+	if (page >= 0xC0 && page <= 0xDD)
+		invalidate(page + 0x20);
+}
+
+void BlockCache::Decode(CodeBlock &block, uint16_t pc, const uint8_t *code)
+{
+	block.key = code;
+	block.pc = pc;
+	block.count = 0;
+#ifdef GBEMU_JIT
+	block.native = nullptr;
+#endif
+
+	// code only reaches to the end of the page.
+	const unsigned available = 0x100 - (pc & 0xFF);
+	unsigned offset = 0;
+
+	while (block.count < CodeBlock::maxInstructions_)
+	{
+		const uint8_t opcode = code[offset];
+		const uint8_t length = GetInstructionLength(opcode);
+		if (offset + length > available) break;
+
+		CachedInstruction &instruction = block.instructions[block.count++];
+		instruction.pc = uint16_t(pc + offset);
+		instruction.opcode = opcode;
+		instruction.length = length;
+		instruction.operand = 0;
+		if (length > 1) instruction.operand = code[offset + 1];
+		if (length > 2) instruction.operand |= code[offset + 2] << 8;
+
+		// ROM never changes, only RAM needs its writes watched.
+		if (pc >= 0x8000)
+			memory_.MarkCode(instruction.pc, length);
+
+		offset += length;
+		if (EndsBlock(opcode)) break;
+	}
+}
+
+uint8_t BlockCache::GetInstructionLength(uint8_t opcode)
+{
+	if (opcode == 0xCB || opcode == 0x10) return 2;
+	return 1 + opcodeInfo[opcode].operands;
+}
+
+bool BlockCache::EndsBlock(uint8_t opcode)
+{
+	switch (opcode)
+	{
+	// JP, JR, CALL, RET, RETI, RST
+	case 0xC3: case 0xC2: case 0xCA: case 0xD2: case 0xDA: case 0xE9:
+	case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+	case 0xCD: case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+	case 0xC9: case 0xC0: case 0xC8: case 0xD0: case 0xD8: case 0xD9:
+	case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+	// HALT, STOP
+	case 0x76: case 0x10:
+		return true;
+
+	case 0xCB:
+		return false;
+
+	default:
+		// Invalid opcodes stop the cpu.
+		return !opcodeInfo[opcode].name;
+	}
+}
+
+}
+
+#endif
\ No newline at end of file
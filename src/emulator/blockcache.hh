@@ -0,0 +1,137 @@
+#pragma once
+
+#include "memory.hh"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <vector>
+
+namespace GBEmu::Emulator
+{
+
+// A predecoded instruction: opcode and its operand bytes, already
+// assembled, so the interpreter does not fetch them through Memory again.
+struct CachedInstruction
+{
+	uint16_t pc;
+	uint16_t operand; // n8 or n16, the second byte of 0xCB / 0x10
+	uint8_t opcode;
+	uint8_t length;
+};
+
+// Straight line run of instructions, ending after the first jump, call,
+// return, HALT or STOP, at the end of a page or after maxInstructions_.
+struct CodeBlock
+{
+	static constexpr int maxInstructions_ = 16;
+
+	// Host address of the first opcode. The same pc in another ROM bank
+	// lives at another host address, so this tells banks apart.
+	const uint8_t *key;
+	uint16_t pc;
+	uint8_t count;
+	CachedInstruction instructions[maxInstructions_];
+#ifdef GBEMU_JIT
+	// Translation of the jit, dropped when the block is decoded again.
+	mutable const void *native;
+#endif
+};
+
+// Direct mapped cache of decoded blocks. Blocks in RAM are dropped when
+// their page is written, Memory traps writes to pages marked as code.
+class BlockCache
+{
+public:
+	BlockCache(Memory &memory);
+
+	// Decoded instruction at pc. Blocks only end with control flow, so
+	// until then the next instruction of the current block is the one at
+	// pc. Anything else looks up the block at pc and decodes it on a
+	// miss. Code that is not backed by a read page (IO, HRAM) or whose
+	// page keeps being written is decoded anew on every fetch.
+	const CachedInstruction &Fetch(uint16_t pc)
+	{
+		if (next_ != end_)
+		{
+			assert(next_->pc == pc);
+			return *next_++;
+		}
+
+		return FetchSlow(pc);
+	}
+
+	// Decodes the instruction at pc through Memory, like the plain switch
+	// core reads it, without looking at or filling the cache.
+	const CachedInstruction &FetchUncached(uint16_t pc);
+
+	// Must be called when the pc changes other than by the fetched
+	// instruction, e.g. for an interrupt.
+	void ResetCursor() { block_ = nullptr; next_ = end_ = nullptr; }
+
+	// Drops all blocks from RAM, whose contents may have been replaced
+	// without going through Memory, e.g. by loading a state.
+	void InvalidateRam();
+
+	static uint8_t GetInstructionLength(uint8_t opcode);
+
+#ifdef GBEMU_JIT
+	// Block instruction is the first of, if Fetch() just returned it.
+	const CodeBlock *GetEnteredBlock(const CachedInstruction &instruction) const
+	{
+		return block_ && &instruction == &block_->instructions[0] ? block_ : nullptr;
+	}
+
+	// The rest of the entered block was run by other means.
+	void SkipBlock() { next_ = end_ = nullptr; }
+
+	// Changes whenever blocks may have become stale: their code was
+	// written, pages were remapped or RAM was replaced.
+	uint32_t GetGeneration() const { return generation_; }
+
+	void DropNative();
+#endif
+
+private:
+	const CachedInstruction &FetchSlow(uint16_t pc);
+	const CodeBlock *Lookup(uint16_t pc);
+	void Decode(CodeBlock &block, uint16_t pc, const uint8_t *code);
+	void InvalidatePage(uint8_t page);
+
+	static size_t GetIndex(uint16_t pc)
+	{
+		const uint8_t page = pc >> 8;
+		const size_t group = (page ^ (page >> 4)) & (groupCount_ - 1);
+		return group * 256 + (pc & 0xFF);
+	}
+
+	static bool EndsBlock(uint8_t opcode);
+
+	// Every pc of a page has its own slot within a group, pages share
+	// groups. Keeps the slots of a page together for InvalidatePage().
+	static constexpr size_t groupCount_ = 16;
+
+	// Pages whose code was overwritten this often are no longer cached,
+	// e.g. code sharing its page with variables it updates.
+	static constexpr uint8_t maxInvalidations_ = 8;
+
+	Memory &memory_;
+	std::vector<CodeBlock> blocks_;
+	std::array<uint8_t, 256> invalidations_;
+
+	// Block being executed and its next instruction. Reset whenever the
+	// block may have become stale.
+	const CodeBlock *block_;
+	const CachedInstruction *next_;
+	const CachedInstruction *end_;
+
+	// Instruction fetched uncached, it is decoded here.
+	CachedInstruction uncached_;
+
+#ifdef GBEMU_JIT
+	uint32_t generation_;
+#endif
+};
+
+}
\ No newline at end of file
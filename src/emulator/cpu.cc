@@ -3,6 +3,8 @@
 #include "io.hh"
 #include "pic.hh"
 #include "log.hh"
+#include "opcodes.hh"
+#include "state.hh"
 
 #include <cstdio>
 #include <cassert>
@@ -11,17 +13,31 @@
 namespace GBEmu::Emulator
 {
 
-Cpu::Cpu(Log &log, Memory &memory, IO &io, Pic &pic)
+Cpu::Cpu(Log &log, Memory &memory, IO &io, Pic &pic, Scheduler &scheduler)
 	:log_(log),
 	memory_(memory),
 	io_(io),
 	pic_(pic),
-	instructions_({}),
+	scheduler_(scheduler),
+	instructionPc_(0),
+	runLimit_(0)
+#ifdef GBEMU_TABLE_CPU
+	,instructions_({}),
 	instructionsCB_({}),
 	instructions10_({})
+#endif
+#ifdef GBEMU_BLOCK_CACHE
+	,blockCache_(memory)
+#endif
+#ifdef GBEMU_JIT
+	,jit_(memory, pic, scheduler, blockCache_, regs_, flags_, interruptsEnabled_, halted_,
+		[this](const CachedInstruction &instruction) { return Execute(instruction); }),
+	jitEnabled_(true)
+#endif
 {
 	Reset();
 
+#ifdef GBEMU_TABLE_CPU
 	Registers &r = regs_;
 	Memory &m = memory_;
 
@@ -970,6 +986,7 @@ Cpu::Cpu(Log &log, Memory &memory, IO &io, Pic &pic)
 		r.pc = pop16();
 		interruptsEnabled_ = true;
 	});
+#endif
 }
 
 void Cpu::Reset()
@@ -980,15 +997,24 @@ void Cpu::Reset()
 	regs_.hl = 0x014D;
 	regs_.sp = 0xFFFE; // TODO populate default stack values
 	regs_.pc = 0x0100;
+#ifndef GBEMU_TABLE_CPU
+	flags_.Unpack(regs_.f);
+#endif
 
 	interruptsEnabled_ = false;
 	halted_ = false;
+
+#ifdef GBEMU_BLOCK_CACHE
+	blockCache_.ResetCursor();
+#endif
 }
 
 uint32_t Cpu::Tick()
 {
 	uint32_t ticks = 0;
 
+	instructionPc_ = regs_.pc;
+
 	// Halted?
 	if (halted_)
 	{
@@ -1007,7 +1033,7 @@ uint32_t Cpu::Tick()
 	}
 
 	// Interrupt?
-	if (interruptsEnabled_)
+	if (interruptsEnabled_ && pic_.InterruptRequested())
 	{
 		uint8_t interruptMask = pic_.GetAndClearInterrupt();
 		if (interruptMask)
@@ -1023,6 +1049,10 @@ uint32_t Cpu::Tick()
 			else if (interruptMask & INT_PIN) regs_.pc = 0x0060;
 			else assert(0);
 
+#ifdef GBEMU_BLOCK_CACHE
+			blockCache_.ResetCursor();
+#endif
+
 			if (log_.InterruptEnabled())
 				log_.Interrupt("Handle " + AsHexString(interruptMask) + " at " + AsHexString(regs_.pc));
 
@@ -1031,6 +1061,22 @@ uint32_t Cpu::Tick()
 		}
 	}
 
+	ticks += Step();
+
+#ifdef GBEMU_TABLE_CPU
+	regs_.f &= 0xF0; // TODO lower bits must be hardwired to 0
+#endif
+
+	if (log_.StateEnabled())
+		log_.State(GetRegisters().ToString());
+
+	// Done. Return number of consumed ticks.
+	return ticks;
+}
+
+#ifdef GBEMU_TABLE_CPU
+uint32_t Cpu::Step()
+{
 	uint16_t instructionLength = 0;
 
 	// Fetch next opcode.
@@ -1075,13 +1121,7 @@ uint32_t Cpu::Tick()
 
 	// Check for invalid instructions.
 	if (!instruction.handler && !instruction.handler2)
-	{
-		log_.Error("Invalid instruction " + AsHexString(opcode) + " at " + AsHexString(opcodeAddr));
-
-		assert(0);
-		getchar();
-		exit(1);
-	}
+		InvalidInstruction(opcode, opcodeAddr);
 
 	// Execute instruction.
 	if (log_.InstructionEnabled())
@@ -1093,15 +1133,28 @@ uint32_t Cpu::Tick()
 	else if (instruction.handler2) instruction.handler2(opcode, operands);
 	else assert(0);
 
-	ticks += instruction.ticks;
+	return instruction.ticks;
+}
+#endif
 
-	regs_.f &= 0xF0; // TODO lower bits must be hardwired to 0
+void Cpu::LogInstruction(uint16_t address)
+{
+	uint8_t opcode = memory_.Read(address);
+	const OpcodeInfo *info = &opcodeInfo[opcode];
 
-	if (log_.StateEnabled())
-		log_.State(regs_.ToString());
+	if (opcode == 0xCB) info = &opcodeInfoCB[memory_.Read(address + 1)];
+	else if (opcode == 0x10) info = &opcodeInfo10[memory_.Read(address + 1)];
 
-	// Done. Return number of consumed ticks.
-	return ticks;
+	log_.Instruction(AsHexString(address) + " -> " + (info->name ? info->name : "???"));
+}
+
+void Cpu::InvalidInstruction(uint8_t opcode, uint16_t address)
+{
+	log_.Error("Invalid instruction " + AsHexString(opcode) + " at " + AsHexString(address));
+
+	assert(0);
+	getchar();
+	exit(1);
 }
 
 void Cpu::Push8(uint8_t v)
@@ -1134,6 +1187,7 @@ uint16_t Cpu::Pop16()
 	return l | (h << 8);
 }
 
+#ifdef GBEMU_TABLE_CPU
 void Cpu::Bitops(uint8_t opcode)
 {
 	uint8_t op = opcode >> 6;
@@ -1193,5 +1247,45 @@ void Cpu::Bitops(uint8_t opcode)
 		}
 	}
 }
+#endif
+
+void Cpu::SetJitEnabled(bool enabled)
+{
+#ifdef GBEMU_JIT
+	jitEnabled_ = enabled;
+	blockCache_.ResetCursor();
+#endif
+}
 
+Registers Cpu::GetRegisters() const
+{
+	Registers regs = regs_;
+#ifndef GBEMU_TABLE_CPU
+	regs.f = flags_.Pack();
+#endif
+	return regs;
+}
+
+void Cpu::SaveState(StateWriter &writer) const
+{
+	writer.Write(GetRegisters());
+	writer.Write(interruptsEnabled_);
+	writer.Write(halted_);
 }
+
+void Cpu::LoadState(StateReader &reader)
+{
+	reader.Read(regs_);
+	reader.Read(interruptsEnabled_);
+	reader.Read(halted_);
+#ifndef GBEMU_TABLE_CPU
+	flags_.Unpack(regs_.f);
+#endif
+
+#ifdef GBEMU_BLOCK_CACHE
+	// RAM was replaced behind Memory's back.
+	blockCache_.InvalidateRam();
+#endif
+}
+
+}
\ No newline at end of file
@@ -1,11 +1,19 @@
 #pragma once
 
+#ifdef GBEMU_BLOCK_CACHE
+#include "blockcache.hh"
+#endif
+#ifdef GBEMU_JIT
+#include "jit.hh"
+#endif
+
 #include <cstdint>
 #include <string>
 #include <sstream>
 #include <iomanip>
 #include <functional>
 #include <array>
+#include <vector>
 
 #include <fstream>
 
@@ -16,6 +24,9 @@ class Log;
 class Memory;
 class IO;
 class Pic;
+class Scheduler;
+class StateWriter;
+class StateReader;
 
 struct Registers
 {
@@ -73,6 +84,40 @@ struct Registers
 
 static_assert(sizeof(Registers) == 12);
 
+#ifndef GBEMU_TABLE_CPU
+// Flags of the switch core. Most instructions set Z and H only for the
+// next one to overwrite them again, so these keep what the flags are
+// computed from and the few readers (conditional branches, PUSH AF, DAA)
+// compute them on demand.
+struct LazyFlags
+{
+	uint8_t z;		// Z is set if this is 0.
+	uint8_t n;
+	uint8_t hx, hy;	// H is set if the low nibble of hx is below the one of hy.
+	uint8_t c;
+
+	bool GetZ() const { return !z; }
+	bool GetH() const { return (hx & 0xF) < (hy & 0xF); }
+
+	void SetH(uint8_t x, uint8_t y) { hx = x; hy = y; }
+	void SetH(bool h) { hx = 0; hy = h; }
+
+	uint8_t Pack() const
+	{
+		return (GetZ() << 7) | (n << 6) | (GetH() << 5) | (c << 4);
+	}
+
+	void Unpack(uint8_t f)
+	{
+		z = !(f & 0x80);
+		n = (f >> 6) & 1;
+		SetH((f & 0x20) != 0);
+		c = (f >> 4) & 1;
+	}
+};
+#endif
+
+#ifdef GBEMU_TABLE_CPU
 using InstructionHandler = std::function<void(uint8_t*)>;
 using InstructionHandler2 = std::function<void(uint8_t, uint8_t*)>;
 
@@ -84,34 +129,86 @@ struct Instruction
 	InstructionHandler handler;
 	InstructionHandler2 handler2;
 };
+#endif
 
 class Cpu
 {
 public:
-	Cpu(Log &log, Memory &memory, IO &io, Pic &pic);
+	Cpu(Log &log, Memory &memory, IO &io, Pic &pic, Scheduler &scheduler);
 
 	void Reset();
+
+	// Runs one instruction, or a translated block of them, and returns
+	// the ticks of the last one. Instructions before it have advanced the
+	// scheduler already, each saw the time it would have seen when run
+	// on its own.
 	uint32_t Tick();
 
+	Registers GetRegisters() const;
+	uint16_t GetPc() const { return regs_.pc; }
+	bool IsHalted() const { return halted_; }
+
+	// pc of the last instruction the last Tick() ran. That is the jump
+	// when a translated block ends with one.
+	uint16_t GetInstructionPc() const { return instructionPc_; }
+
+	// Translated blocks only run while they end before this tick, e.g.
+	// the end of the current RunCycles(), and before the next scheduler
+	// deadline.
+	void SetRunLimit(uint64_t ticks) { runLimit_ = ticks; }
+
+	// Disabled, every instruction is interpreted and fetched through
+	// Memory, as in a build without the jit. The reference for checking
+	// the jit, does nothing in other builds.
+	void SetJitEnabled(bool enabled);
+
+	void SaveState(StateWriter &writer) const;
+	void LoadState(StateReader &reader);
+
 private:
+	uint32_t Step();
+#ifdef GBEMU_BLOCK_CACHE
+	uint32_t Execute(const CachedInstruction &instruction);
+#endif
+	void LogInstruction(uint16_t address);
+	[[noreturn]] void InvalidInstruction(uint8_t opcode, uint16_t address);
+
 	void Push8(uint8_t v);
 	void Push16(uint16_t v);
 	uint8_t Pop8();
 	uint16_t Pop16();
+#ifdef GBEMU_TABLE_CPU
 	void Bitops(uint8_t opcode);
+#endif
 
 private:
 	Log & log_;
 	Memory & memory_;
 	IO & io_;
 	Pic & pic_;
+	Scheduler & scheduler_;
 	Registers regs_;
+#ifndef GBEMU_TABLE_CPU
+	LazyFlags flags_;
+#endif
 	bool interruptsEnabled_;
 	bool halted_;
+	uint16_t instructionPc_;
+	uint64_t runLimit_;
 
+#ifdef GBEMU_TABLE_CPU
 	std::array<Instruction, 256> instructions_;
 	std::array<Instruction, 256> instructionsCB_;
 	std::array<Instruction, 256> instructions10_;
+#endif
+
+#ifdef GBEMU_BLOCK_CACHE
+	BlockCache blockCache_;
+#endif
+#ifdef GBEMU_JIT
+	Jit jit_;
+	bool jitEnabled_;
+#endif
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,668 @@
+#include "cpu.hh"
+#include "memory.hh"
+#include "pic.hh"
+#include "scheduler.hh"
+#include "log.hh"
+#include "instructionspec.hh"
+
+#include <cassert>
+#include <utility>
+
+#ifndef GBEMU_TABLE_CPU
+
+// Switch based interpreter core. All handlers are inlined into one dense
+// switch statement which the compiler turns into a single jump table. The
+// mnemonics live in opcodes.cc and are only touched for logging.
+//
+// Flags are kept in LazyFlags (cpu.hh) rather than in F, Z and H are only
+// computed when something reads them.
+//
+// Build with -DGBEMU_JIT to fetch instructions from predecoded blocks
+// (blockcache.hh) instead of reading them through Memory, and to run the
+// blocks as x86-64 code (jit.hh) wherever the interpreter would run them
+// back to back.
+//
+// Semantics (including flag quirks and cycle counts) mirror the table core
+// in cpu.cc, build with -DGBEMU_TABLE_CPU to compare both.
+
+namespace GBEmu::Emulator
+{
+
+namespace
+{
+
+inline void AddA(Registers &r, LazyFlags &f, uint8_t n)
+{
+	uint8_t a0 = r.a;
+	uint8_t a1 = r.a + n;
+
+	r.a = a1;
+	f.z = a1;
+	f.n = 0;
+	f.SetH(a1, a0);
+	f.c = a1 < a0;
+}
+
+inline void AdcA(Registers &r, LazyFlags &f, uint8_t n)
+{
+	uint8_t a0 = r.a;
+	uint8_t a1 = r.a + f.c + n;
+
+	r.a = a1;
+	f.z = a1;
+	f.n = 0;
+	f.SetH(a1, a0);
+	f.c = a1 < a0;
+}
+
+inline void SubA(Registers &r, LazyFlags &f, uint8_t n)
+{
+	uint8_t a0 = r.a;
+	uint8_t a1 = r.a - n;
+
+	r.a = a1;
+	f.z = a1;
+	f.n = 1;
+	f.SetH(a0, n);
+	f.c = a0 < n;
+}
+
+inline void SbcA(Registers &r, LazyFlags &f, uint8_t n)
+{
+	uint8_t a0 = r.a;
+	uint8_t a1 = r.a - f.c - n;
+	int n1 = n + f.c;
+
+	r.a = a1;
+	f.z = a1;
+	f.n = 1;
+	f.SetH(a0, uint8_t(n1));
+	f.c = a0 < n1;
+}
+
+inline void AndA(Registers &r, LazyFlags &f, uint8_t n)
+{
+	r.a &= n;
+	f.z = r.a;
+	f.n = 0;
+	f.SetH(true);
+	f.c = 0;
+}
+
+inline void OrA(Registers &r, LazyFlags &f, uint8_t n)
+{
+	r.a |= n;
+	f.z = r.a;
+	f.n = 0;
+	f.SetH(false);
+	f.c = 0;
+}
+
+inline void XorA(Registers &r, LazyFlags &f, uint8_t n)
+{
+	r.a ^= n;
+	f.z = r.a;
+	f.n = 0;
+	f.SetH(false);
+	f.c = 0;
+}
+
+inline void CpA(Registers &r, LazyFlags &f, uint8_t n)
+{
+	f.z = r.a - n;
+	f.n = 1;
+	f.SetH(r.a, n);
+	f.c = r.a < n;
+}
+
+// INC and DEC leave C alone. Their half carry is the one of adding or
+// subtracting 1, which the nibble compare gives as well.
+inline uint8_t Inc(LazyFlags &f, uint8_t v)
+{
+	v++;
+	f.z = v;
+	f.n = 0;
+	f.SetH(v, v - 1);
+	return v;
+}
+
+inline uint8_t Dec(LazyFlags &f, uint8_t v)
+{
+	v--;
+	f.z = v;
+	f.n = 1;
+	f.SetH(v + 1, 1);
+	return v;
+}
+
+inline void AddHL(Registers &r, LazyFlags &f, uint16_t n)
+{
+	uint16_t hl0 = r.hl;
+	uint16_t hl1 = r.hl + n;
+
+	r.hl = hl1;
+	f.n = 0;
+	f.SetH((hl1 & 0xFFF) < (hl0 & 0xFFF));
+	f.c = hl1 < hl0;
+}
+
+inline uint16_t AddSP(Registers &r, LazyFlags &f, uint8_t operand)
+{
+	int8_t n = reinterpret_cast<int8_t&>(operand);
+	uint16_t sp0 = r.sp;
+	uint16_t sp1 = sp0 + n;
+
+	f.z = 1;
+	f.n = 0;
+
+	if (n > 0)
+	{
+		f.SetH((sp1 & 0xF) < (sp0 & 0xF));
+		f.c = sp1 < sp0;
+	}
+	else
+	{
+		f.SetH((sp1 & 0xF) > (sp0 & 0xF));
+		f.c = sp1 > sp0;
+	}
+
+	return sp1;
+}
+
+inline void Daa(Registers &r, LazyFlags &f)
+{
+	uint16_t a = r.a;
+
+	if (!f.n)
+	{
+		if (f.GetH() || (a & 0xF) > 9)
+			a += 0x06;
+		if (f.c || a > 0x9F)
+			a += 0x60;
+	}
+	else
+	{
+		if (f.GetH())
+			a = (a - 6) & 0xFF;
+		if (f.c)
+			a -= 0x60;
+	}
+
+	f.SetH(false);
+
+	if ((a & 0x100) == 0x100)
+		f.c = 1;
+
+	a &= 0xFF;
+	f.z = uint8_t(a);
+
+	r.a = uint8_t(a);
+}
+
+inline uint8_t Swap(LazyFlags &f, uint8_t v)
+{
+	uint8_t res = (v >> 4) | (v << 4);
+	f.z = res;
+	f.n = 0;
+	f.SetH(false);
+	f.c = 0;
+	return res;
+}
+
+inline uint8_t Rlc(LazyFlags &f, uint8_t n)
+{
+	uint8_t n1 = n << 1;
+	f.z = n1;
+	f.n = 0;
+	f.SetH(false);
+	f.c = (n & 0x80) == 0x80;
+	return n1;
+}
+
+inline uint8_t Rl(LazyFlags &f, uint8_t n)
+{
+	uint8_t n1 = (n << 1) | f.c;
+	f.z = n1;
+	f.n = 0;
+	f.SetH(false);
+	f.c = (n & 0x80) == 0x80;
+	return n1;
+}
+
+inline uint8_t Rrc(LazyFlags &f, uint8_t n)
+{
+	uint8_t n1 = n >> 1;
+	f.z = n1;
+	f.n = 0;
+	f.SetH(false);
+	f.c = n & 1;
+	return n1;
+}
+
+inline uint8_t Rr(LazyFlags &f, uint8_t n)
+{
+	uint8_t n1 = (n >> 1) | (f.c << 7);
+	f.z = n1;
+	f.n = 0;
+	f.SetH(false);
+	f.c = n & 1;
+	return n1;
+}
+
+inline uint8_t Sla(LazyFlags &f, uint8_t n)
+{
+	uint8_t n1 = n << 1;
+	f.z = n1;
+	f.n = 0;
+	f.SetH(false);
+	f.c = (n & 0x80) == 0x80;
+	return n1;
+}
+
+inline uint8_t Sra(LazyFlags &f, uint8_t n)
+{
+	uint8_t n1 = (n >> 1) | (n & 0x80);
+	f.z = n1;
+	f.n = 0;
+	f.SetH(false);
+	f.c = n & 1;
+	return n1;
+}
+
+inline uint8_t Srl(LazyFlags &f, uint8_t n)
+{
+	uint8_t n1 = n >> 1;
+	f.z = n1;
+	f.n = 0;
+	f.SetH(false);
+	f.c = n & 1;
+	return n1;
+}
+
+template<Operand operand>
+inline uint8_t ReadOperand(Registers &r, Memory &m)
+{
+	if constexpr (operand == Operand::B) return r.b;
+	else if constexpr (operand == Operand::C) return r.c;
+	else if constexpr (operand == Operand::D) return r.d;
+	else if constexpr (operand == Operand::E) return r.e;
+	else if constexpr (operand == Operand::H) return r.h;
+	else if constexpr (operand == Operand::L) return r.l;
+	else if constexpr (operand == Operand::A) return r.a;
+	else return m.Read(r.hl);
+}
+
+template<Operand operand>
+inline void WriteOperand(Registers &r, Memory &m, uint8_t v)
+{
+	if constexpr (operand == Operand::B) r.b = v;
+	else if constexpr (operand == Operand::C) r.c = v;
+	else if constexpr (operand == Operand::D) r.d = v;
+	else if constexpr (operand == Operand::E) r.e = v;
+	else if constexpr (operand == Operand::H) r.h = v;
+	else if constexpr (operand == Operand::L) r.l = v;
+	else if constexpr (operand == Operand::A) r.a = v;
+	else m.Write(r.hl, v);
+}
+
+// Handlers for the regular blocks of instructionspec.hh, one instance per
+// opcode with operation and registers resolved at compile time. The pc
+// already points past the instruction.
+using HandlerCB = uint32_t (*)(Registers &r, LazyFlags &f, Memory &m);
+
+template<uint8_t opcode>
+uint32_t ExecuteRegular(Registers &r, LazyFlags &f, Memory &m)
+{
+	constexpr InstructionSpec spec = instructionSpecs[opcode];
+	const uint8_t v = ReadOperand<spec.source>(r, m);
+
+	if constexpr (spec.operation == Operation::Ld) WriteOperand<spec.target>(r, m, v);
+	else if constexpr (spec.operation == Operation::Add) AddA(r, f, v);
+	else if constexpr (spec.operation == Operation::Adc) AdcA(r, f, v);
+	else if constexpr (spec.operation == Operation::Sub) SubA(r, f, v);
+	else if constexpr (spec.operation == Operation::Sbc) SbcA(r, f, v);
+	else if constexpr (spec.operation == Operation::And) AndA(r, f, v);
+	else if constexpr (spec.operation == Operation::Xor) XorA(r, f, v);
+	else if constexpr (spec.operation == Operation::Or) OrA(r, f, v);
+	else if constexpr (spec.operation == Operation::Cp) CpA(r, f, v);
+	else static_assert(spec.operation == Operation::Ld, "not a regular opcode");
+
+	return spec.ticks;
+}
+
+template<uint8_t opcode>
+uint32_t ExecuteCB(Registers &r, LazyFlags &f, Memory &m)
+{
+	constexpr InstructionSpec spec = instructionSpecsCB[opcode];
+	const uint8_t v = ReadOperand<spec.target>(r, m);
+
+	if constexpr (spec.operation == Operation::Bit)
+	{
+		f.z = v & (1 << spec.bit);
+		f.n = 0;
+		f.SetH(true);
+	}
+	else
+	{
+		uint8_t v1 = 0;
+		if constexpr (spec.operation == Operation::Rlc) v1 = Rlc(f, v);
+		else if constexpr (spec.operation == Operation::Rrc) v1 = Rrc(f, v);
+		else if constexpr (spec.operation == Operation::Rl) v1 = Rl(f, v);
+		else if constexpr (spec.operation == Operation::Rr) v1 = Rr(f, v);
+		else if constexpr (spec.operation == Operation::Sla) v1 = Sla(f, v);
+		else if constexpr (spec.operation == Operation::Sra) v1 = Sra(f, v);
+		else if constexpr (spec.operation == Operation::Swap) v1 = Swap(f, v);
+		else if constexpr (spec.operation == Operation::Srl) v1 = Srl(f, v);
+		else if constexpr (spec.operation == Operation::Res) v1 = v & ~(1 << spec.bit);
+		else if constexpr (spec.operation == Operation::Set) v1 = v | (1 << spec.bit);
+		WriteOperand<spec.target>(r, m, v1);
+	}
+
+	return spec.ticks;
+}
+
+template<size_t... opcodes>
+constexpr std::array<HandlerCB, 256> MakeHandlersCB(std::index_sequence<opcodes...>)
+{
+	return { &ExecuteCB<opcodes>... };
+}
+
+constexpr std::array<HandlerCB, 256> handlersCB = MakeHandlersCB(std::make_index_sequence<0x100>());
+
+}
+
+#ifdef GBEMU_BLOCK_CACHE
+uint32_t Cpu::Step()
+{
+#ifdef GBEMU_JIT
+	// The reference the jit is checked against, see SetJitEnabled().
+	if (!jitEnabled_)
+		return Execute(blockCache_.FetchUncached(regs_.pc));
+#endif
+	const CachedInstruction &instruction = blockCache_.Fetch(regs_.pc);
+
+#ifdef GBEMU_JIT
+	// Blocks entered at their start run natively, unless every
+	// instruction is logged.
+	if (const CodeBlock *block = blockCache_.GetEnteredBlock(instruction);
+		block && !log_.InstructionEnabled() && !log_.StateEnabled())
+	{
+		uint32_t ticks;
+		if (jit_.Run(*block, runLimit_, ticks, instructionPc_))
+		{
+			blockCache_.SkipBlock();
+			return ticks;
+		}
+	}
+#endif
+	return Execute(instruction);
+}
+
+uint32_t Cpu::Execute(const CachedInstruction &instruction)
+#else
+uint32_t Cpu::Step()
+#endif
+{
+	Registers &r = regs_;
+	LazyFlags &f = flags_;
+	Memory &m = memory_;
+
+	const uint16_t pc = r.pc;
+
+#ifdef GBEMU_BLOCK_CACHE
+	// Operands were decoded along with the opcode.
+	const uint8_t opcode = instruction.opcode;
+
+	auto n8 = [&]() -> uint8_t { return instruction.operand & 0xFF; };
+	auto n16 = [&]() -> uint16_t { return instruction.operand; };
+#else
+	const uint8_t opcode = m.Read(pc);
+
+	// Operand fetchers. Operands are always read before the instruction has
+	// any side effects, same as in the table core.
+	auto n8 = [&]() -> uint8_t { return m.Read(pc + 1); };
+	auto n16 = [&]() -> uint16_t { return m.Read(pc + 1) | (m.Read(pc + 2) << 8); };
+#endif
+	auto e8 = [&]() -> int8_t { uint8_t v = n8(); return reinterpret_cast<int8_t&>(v); };
+
+	if (log_.InstructionEnabled())
+		LogInstruction(pc);
+
+	auto push16 = [&](uint16_t v)
+	{
+		r.sp -= 2;
+		m.Write(r.sp + 0, v & 0xFF);
+		m.Write(r.sp + 1, v >> 8);
+	};
+
+	auto pop16 = [&]() -> uint16_t
+	{
+		uint8_t l = m.Read(r.sp + 0);
+		uint8_t h = m.Read(r.sp + 1);
+		r.sp += 2;
+		return l | (h << 8);
+	};
+
+	// LD r,r' (40-7F) and ALU A,r (80-BF) are instantiated from the
+	// instruction spec, 76 is HALT.
+#define REGULAR_CASE(opcode) \
+	case opcode: r.pc = pc + 1; return ExecuteRegular<opcode>(r, f, m);
+#define REGULAR_CASES8(base) \
+	REGULAR_CASE(base + 0) REGULAR_CASE(base + 1) REGULAR_CASE(base + 2) REGULAR_CASE(base + 3) \
+	REGULAR_CASE(base + 4) REGULAR_CASE(base + 5) REGULAR_CASE(base + 6) REGULAR_CASE(base + 7)
+
+	switch (opcode)
+	{
+	REGULAR_CASES8(0x40)
+	REGULAR_CASES8(0x48)
+	REGULAR_CASES8(0x50)
+	REGULAR_CASES8(0x58)
+	REGULAR_CASES8(0x60)
+	REGULAR_CASES8(0x68)
+	REGULAR_CASE(0x70)
+	REGULAR_CASE(0x71)
+	REGULAR_CASE(0x72)
+	REGULAR_CASE(0x73)
+	REGULAR_CASE(0x74)
+	REGULAR_CASE(0x75)
+	REGULAR_CASE(0x77)
+	REGULAR_CASES8(0x78)
+	REGULAR_CASES8(0x80)
+	REGULAR_CASES8(0x88)
+	REGULAR_CASES8(0x90)
+	REGULAR_CASES8(0x98)
+	REGULAR_CASES8(0xA0)
+	REGULAR_CASES8(0xA8)
+	REGULAR_CASES8(0xB0)
+	REGULAR_CASES8(0xB8)
+
+	// 3.3.1 8-Bit Loads
+	case 0x06: r.b = n8(); r.pc = pc + 2; return 8;
+	case 0x0E: r.c = n8(); r.pc = pc + 2; return 8;
+	case 0x16: r.d = n8(); r.pc = pc + 2; return 8;
+	case 0x1E: r.e = n8(); r.pc = pc + 2; return 8;
+	case 0x26: r.h = n8(); r.pc = pc + 2; return 8;
+	case 0x2E: r.l = n8(); r.pc = pc + 2; return 8;
+	case 0x3E: r.a = n8(); r.pc = pc + 2; return 8;
+
+	case 0x36: { uint8_t n = n8(); r.pc = pc + 2; m.Write(r.hl, n); return 12; }
+
+	case 0x0A: r.pc = pc + 1; r.a = m.Read(r.bc); return 8;
+	case 0x1A: r.pc = pc + 1; r.a = m.Read(r.de); return 8;
+	case 0xFA: { uint16_t nn = n16(); r.pc = pc + 3; r.a = m.Read(nn); return 16; }
+	case 0x02: r.pc = pc + 1; m.Write(r.bc, r.a); return 8;
+	case 0x12: r.pc = pc + 1; m.Write(r.de, r.a); return 8;
+	case 0xEA: { uint16_t nn = n16(); r.pc = pc + 3; m.Write(nn, r.a); return 16; }
+	case 0xF2: r.pc = pc + 1; r.a = m.Read(0xFF00 + r.c); return 8;
+	case 0xE2: r.pc = pc + 1; m.Write(0xFF00 + r.c, r.a); return 8;
+	case 0x3A: r.pc = pc + 1; r.a = m.Read(r.hl); r.hl--; return 8;
+	case 0x32: r.pc = pc + 1; m.Write(r.hl, r.a); r.hl--; return 8;
+	case 0x2A: r.pc = pc + 1; r.a = m.Read(r.hl); r.hl++; return 8;
+	case 0x22: r.pc = pc + 1; m.Write(r.hl, r.a); r.hl++; return 8;
+	case 0xE0: { uint8_t n = n8(); r.pc = pc + 2; m.Write(0xFF00 + n, r.a); return 12; }
+	case 0xF0: { uint8_t n = n8(); r.pc = pc + 2; r.a = m.Read(0xFF00 + n); return 12; }
+
+	// 3.3.2 16-Bit Loads
+	case 0x01: r.bc = n16(); r.pc = pc + 3; return 12;
+	case 0x11: r.de = n16(); r.pc = pc + 3; return 12;
+	case 0x21: r.hl = n16(); r.pc = pc + 3; return 12;
+	case 0x31: r.sp = n16(); r.pc = pc + 3; return 12;
+	case 0xF9: r.sp = r.hl; r.pc = pc + 1; return 8;
+	case 0xF8:
+	{
+		int8_t n = e8();
+		r.pc = pc + 2;
+		r.hl = r.sp + n;
+		f.z = 1;
+		f.n = 0;
+		if (n > 0)
+		{
+			f.SetH((r.hl & 0xF) < (r.sp & 0xF));
+			f.c = r.hl < r.sp;
+		}
+		else
+		{
+			f.SetH((r.hl & 0xF) > (r.sp & 0xF));
+			f.c = r.hl > r.sp;
+		}
+		return 12;
+	}
+	case 0x08:
+	{
+		uint16_t nn = n16();
+		r.pc = pc + 3;
+		m.Write(nn + 0, r.spl);
+		m.Write(nn + 1, r.sph);
+		return 20;
+	}
+	case 0xF5: r.pc = pc + 1; r.f = f.Pack(); push16(r.af); return 16;
+	case 0xC5: r.pc = pc + 1; push16(r.bc); return 16;
+	case 0xD5: r.pc = pc + 1; push16(r.de); return 16;
+	case 0xE5: r.pc = pc + 1; push16(r.hl); return 16;
+	case 0xF1: r.pc = pc + 1; r.af = pop16(); f.Unpack(r.f); return 12;
+	case 0xC1: r.pc = pc + 1; r.bc = pop16(); return 12;
+	case 0xD1: r.pc = pc + 1; r.de = pop16(); return 12;
+	case 0xE1: r.pc = pc + 1; r.hl = pop16(); return 12;
+
+	// 3.3.3 8-Bit ALU
+	case 0xC6: { uint8_t n = n8(); r.pc = pc + 2; AddA(r, f, n); return 8; }
+	case 0xCE: { uint8_t n = n8(); r.pc = pc + 2; AdcA(r, f, n); return 8; }
+	case 0xD6: { uint8_t n = n8(); r.pc = pc + 2; SubA(r, f, n); return 8; }
+	case 0xDE: { uint8_t n = n8(); r.pc = pc + 2; SbcA(r, f, n); return 8; }
+	case 0xE6: { uint8_t n = n8(); r.pc = pc + 2; AndA(r, f, n); return 8; }
+	case 0xF6: { uint8_t n = n8(); r.pc = pc + 2; OrA(r, f, n); return 8; }
+	case 0xEE: { uint8_t n = n8(); r.pc = pc + 2; XorA(r, f, n); return 8; }
+	case 0xFE: { uint8_t n = n8(); r.pc = pc + 2; CpA(r, f, n); return 8; }
+	case 0x3C: r.a = Inc(f, r.a); r.pc = pc + 1; return 4;
+	case 0x04: r.b = Inc(f, r.b); r.pc = pc + 1; return 4;
+	case 0x0C: r.c = Inc(f, r.c); r.pc = pc + 1; return 4;
+	case 0x14: r.d = Inc(f, r.d); r.pc = pc + 1; return 4;
+	case 0x1C: r.e = Inc(f, r.e); r.pc = pc + 1; return 4;
+	case 0x24: r.h = Inc(f, r.h); r.pc = pc + 1; return 4;
+	case 0x2C: r.l = Inc(f, r.l); r.pc = pc + 1; return 4;
+	case 0x34: { r.pc = pc + 1; uint8_t v = Inc(f, m.Read(r.hl)); m.Write(r.hl, v); return 12; }
+	case 0x3D: r.a = Dec(f, r.a); r.pc = pc + 1; return 4;
+	case 0x05: r.b = Dec(f, r.b); r.pc = pc + 1; return 4;
+	case 0x0D: r.c = Dec(f, r.c); r.pc = pc + 1; return 4;
+	case 0x15: r.d = Dec(f, r.d); r.pc = pc + 1; return 4;
+	case 0x1D: r.e = Dec(f, r.e); r.pc = pc + 1; return 4;
+	case 0x25: r.h = Dec(f, r.h); r.pc = pc + 1; return 4;
+	case 0x2D: r.l = Dec(f, r.l); r.pc = pc + 1; return 4;
+	case 0x35: { r.pc = pc + 1; uint8_t v = Dec(f, m.Read(r.hl)); m.Write(r.hl, v); return 12; }
+
+	// 3.3.4 16-Bit Arithmetic
+	case 0x09: AddHL(r, f, r.bc); r.pc = pc + 1; return 8;
+	case 0x19: AddHL(r, f, r.de); r.pc = pc + 1; return 8;
+	case 0x29: AddHL(r, f, r.hl); r.pc = pc + 1; return 8;
+	case 0x39: AddHL(r, f, r.sp); r.pc = pc + 1; return 8;
+	case 0xE8: { uint8_t n = n8(); r.pc = pc + 2; r.sp = AddSP(r, f, n); return 16; }
+	case 0x03: r.bc++; r.pc = pc + 1; return 8;
+	case 0x13: r.de++; r.pc = pc + 1; return 8;
+	case 0x23: r.hl++; r.pc = pc + 1; return 8;
+	case 0x33: r.sp++; r.pc = pc + 1; return 8;
+	case 0x0B: r.bc--; r.pc = pc + 1; return 8;
+	case 0x1B: r.de--; r.pc = pc + 1; return 8;
+	case 0x2B: r.hl--; r.pc = pc + 1; return 8;
+	case 0x3B: r.sp--; r.pc = pc + 1; return 8;
+
+	// 3.3.5 Miscellaneous
+	case 0x27: Daa(r, f); r.pc = pc + 1; return 27;
+	case 0x2F: r.a = ~r.a; f.n = 1; f.SetH(true); r.pc = pc + 1; return 4;
+	case 0x3F: f.n = 0; f.SetH(false); f.c ^= 1; r.pc = pc + 1; return 4;
+	case 0x37: f.n = 0; f.SetH(false); f.c = 1; r.pc = pc + 1; return 4;
+	case 0x00: r.pc = pc + 1; return 4;
+	case 0x76: halted_ = true; r.pc = pc + 1; return 4;
+	case 0xF3: interruptsEnabled_ = false; r.pc = pc + 1; return 4;
+	case 0xFB: interruptsEnabled_ = true; r.pc = pc + 1; return 4;
+	case 0x10:
+	{
+		// STOP is the only valid 0x10-prefixed instruction.
+		uint8_t opcode10 = n8();
+		if (opcode10 != 0x00)
+			InvalidInstruction(opcode10, pc + 1);
+		r.pc = pc + 2;
+		return 4;
+	}
+
+	// 3.3.6 Rotates & Shifts
+	case 0x07: r.a = Rlc(f, r.a); r.pc = pc + 1; return 4;
+	case 0x17: r.a = Rl(f, r.a); r.pc = pc + 1; return 4;
+	case 0x0F: r.a = Rrc(f, r.a); r.pc = pc + 1; return 4;
+	case 0x1F: r.a = Rr(f, r.a); r.pc = pc + 1; return 4;
+
+	case 0xCB:
+	{
+		const uint8_t opcodeCB = n8();
+		r.pc = pc + 2;
+		return handlersCB[opcodeCB](r, f, m);
+	}
+
+	// 3.3.8 Jumps
+	case 0xC3: r.pc = n16(); return 12;
+	case 0xC2: { uint16_t nn = n16(); r.pc = pc + 3; if (!f.GetZ()) r.pc = nn; return 12; }
+	case 0xCA: { uint16_t nn = n16(); r.pc = pc + 3; if (f.GetZ()) r.pc = nn; return 12; }
+	case 0xD2: { uint16_t nn = n16(); r.pc = pc + 3; if (!f.c) r.pc = nn; return 12; }
+	case 0xDA: { uint16_t nn = n16(); r.pc = pc + 3; if (f.c) r.pc = nn; return 12; }
+	case 0xE9: r.pc = r.hl; return 4;
+	case 0x18: { int8_t n = e8(); r.pc = pc + 2 + n; return 8; }
+	case 0x20: { int8_t n = e8(); r.pc = pc + 2; if (!f.GetZ()) r.pc += n; return 8; }
+	case 0x28: { int8_t n = e8(); r.pc = pc + 2; if (f.GetZ()) r.pc += n; return 8; }
+	case 0x30: { int8_t n = e8(); r.pc = pc + 2; if (!f.c) r.pc += n; return 8; }
+	case 0x38: { int8_t n = e8(); r.pc = pc + 2; if (f.c) r.pc += n; return 8; }
+
+	// 3.3.9 Calls
+	case 0xCD: { uint16_t nn = n16(); r.pc = pc + 3; push16(r.pc); r.pc = nn; return 12; }
+	case 0xC4: { uint16_t nn = n16(); r.pc = pc + 3; if (!f.GetZ()) { push16(r.pc); r.pc = nn; } return 12; }
+	case 0xCC: { uint16_t nn = n16(); r.pc = pc + 3; if (f.GetZ()) { push16(r.pc); r.pc = nn; } return 12; }
+	case 0xD4: { uint16_t nn = n16(); r.pc = pc + 3; if (!f.c) { push16(r.pc); r.pc = nn; } return 12; }
+	case 0xDC: { uint16_t nn = n16(); r.pc = pc + 3; if (f.c) { push16(r.pc); r.pc = nn; } return 12; }
+
+	// 3.3.10 Restarts
+	case 0xC7: r.pc = pc + 1; push16(r.pc); r.pc = 0x00; return 32;
+	case 0xCF: r.pc = pc + 1; push16(r.pc); r.pc = 0x08; return 32;
+	case 0xD7: r.pc = pc + 1; push16(r.pc); r.pc = 0x10; return 32;
+	case 0xDF: r.pc = pc + 1; push16(r.pc); r.pc = 0x18; return 32;
+	case 0xE7: r.pc = pc + 1; push16(r.pc); r.pc = 0x20; return 32;
+	case 0xEF: r.pc = pc + 1; push16(r.pc); r.pc = 0x28; return 32;
+	case 0xF7: r.pc = pc + 1; push16(r.pc); r.pc = 0x30; return 32;
+	case 0xFF: r.pc = pc + 1; push16(r.pc); r.pc = 0x38; return 32;
+
+	// 3.3.11 Returns
+	case 0xC9: r.pc = pc + 1; r.pc = pop16(); return 8;
+	case 0xC0: r.pc = pc + 1; if (!f.GetZ()) r.pc = pop16(); return 8;
+	case 0xC8: r.pc = pc + 1; if (f.GetZ()) r.pc = pop16(); return 8;
+	case 0xD0: r.pc = pc + 1; if (!f.c) r.pc = pop16(); return 8;
+	case 0xD8: r.pc = pc + 1; if (f.c) r.pc = pop16(); return 8;
+	case 0xD9: r.pc = pc + 1; r.pc = pop16(); interruptsEnabled_ = true; return 8;
+
+	default:
+		InvalidInstruction(opcode, pc);
+	}
+
+#undef REGULAR_CASES8
+#undef REGULAR_CASE
+}
+
+}
+
+#endif
\ No newline at end of file
@@ -1,9 +1,12 @@
 #include "display.hh"
 #include "io.hh"
 #include "pic.hh"
-#include "ram.hh"
+#include "scheduler.hh"
+#include "state.hh"
+#include "vram.hh"
 
 #include <cassert>
+#include <cstring>
 
 namespace GBEmu::Emulator
 {
@@ -29,14 +32,30 @@ void SpriteAttributeTable::Write(uint16_t offset, uint8_t data)
 	table_[offset] = data;
 }
 
-Display::Display(IO &io, Pic &pic, Ram &vram, SpriteAttributeTable &oam, DisplayBitmap *debugBitmap, DisplayBitmap &displayBitmap)
+void SpriteAttributeTable::SaveState(StateWriter &writer) const
+{
+	writer.Write(table_);
+}
+
+void SpriteAttributeTable::LoadState(StateReader &reader)
+{
+	reader.Read(table_);
+}
+
+Display::Display(IO &io, Pic &pic, Scheduler &scheduler, Vram &vram, SpriteAttributeTable &oam, DisplayBitmap *debugBitmap, DisplayBitmap &displayBitmap)
 	:io_(io),
 	pic_(pic),
+	scheduler_(scheduler),
 	vram_(vram),
 	oam_(oam),
 	debugBitmap_(debugBitmap),
 	displayBitmap_(displayBitmap),	
-	lyTicks_(0),
+	lineEvent_(-1),
+	lineStart_(scheduler.GetNow()),
+	outputSuppressed_(false),
+	frameOutput_(true),
+	frame_({}),
+	debugFrame_({}),
 	lcdc_(0),
 	lcds_(0),
 	scx_(0),
@@ -45,102 +64,175 @@ Display::Display(IO &io, Pic &pic, Ram &vram, SpriteAttributeTable &oam, Display
 	lyc_(0),
 	wx_(0),
 	wy_(0),
-	bgp_(0)
+	bgp_(0),
+	bgpColors_({})
 {
+	UpdatePalette();
+
 	// LCD Control
 	io_.Register("LCDC", 0x40, [&]() { return lcdc_; }, [&](uint8_t v) { lcdc_ = v; });
 
 	// LCD Status
-	io_.Register("LCDS", 0x41, [&]() { return lcds_; }, [&](uint8_t v) {
-		lcds_ = (v & 0x78) | (lcds_ & 0x7);
+	io_.Register("LCDS", 0x41, [&]() { return GetStatus(); }, [&](uint8_t v) {
+		// Mode and coincidence flag are read only.
+		lcds_ = v & 0x78;
 	});
 
 	// Monochrome Palettes
-	io_.Register("BGP", 0x47, [&]() { return bgp_; }, [&](uint8_t v) { bgp_ = v; });
+	io_.Register("BGP", 0x47, [&]() { return bgp_; }, [&](uint8_t v) { bgp_ = v; UpdatePalette(); });
 	io_.Register("OBP0", 0x48, []() { return 0; }, [](uint8_t v) { });
 	io_.Register("OBP1", 0x49, []() { return 0; }, [](uint8_t v) { });
 
 	// LCD Position and Scrolling
 	io_.Register("SCY", 0x42, [&]() { return scy_; }, [&](uint8_t v) { scy_ = v; });
 	io_.Register("SCX", 0x43, [&]() { return scx_; }, [&](uint8_t v) { scx_ = v; });
-	io_.Register("LY", 0x44, [&]() { return ly_++; }, [&](uint8_t v) { ly_ = 0; });
+	io_.Register("LY", 0x44, [&]() { return GetLy(); }, [&](uint8_t v) { ly_ = 0; });
 	io_.Register("LYC", 0x45, [&]() { return lyc_; }, [&](uint8_t v) { lyc_ = v; });
 	io_.Register("WY", 0x4A, [&]() { return wy_; }, [&](uint8_t v) { wy_ = v; });
 	io_.Register("WX", 0x4B, [&]() { return wx_; }, [&](uint8_t v) { wx_ = v; });
+
+	lineEvent_ = scheduler_.Register([&](uint64_t deadline) { EndOfLine(deadline); });
+	scheduler_.Schedule(lineEvent_, scheduler_.GetNow() + lineTicks_);
 }
 
-void Display::Tick(int ticksPassed)
+void Display::SaveState(StateWriter &writer) const
+{
+	writer.Write(lineStart_);
+	writer.Write(lcdc_);
+	writer.Write(lcds_);
+	writer.Write(scx_);
+	writer.Write(scy_);
+	writer.Write(ly_);
+	writer.Write(lyc_);
+	writer.Write(wx_);
+	writer.Write(wy_);
+	writer.Write(bgp_);
+}
+
+void Display::LoadState(StateReader &reader)
+{
+	reader.Read(lineStart_);
+	reader.Read(lcdc_);
+	reader.Read(lcds_);
+	reader.Read(scx_);
+	reader.Read(scy_);
+	reader.Read(ly_);
+	reader.Read(lyc_);
+	reader.Read(wx_);
+	reader.Read(wy_);
+	reader.Read(bgp_);
+
+	UpdatePalette();
+}
+
+void Display::EndOfLine(uint64_t deadline)
 {
 	// CPU clock: 4.194304MHz
 	// The LY can take on any value between 0 through 153.
 	// The values between 144 and 153 indicate the V-Blank period. Writing will reset the counter.
 	// LY 00..144..153(vblank)
-	// 60 * 154 = 9240
-	// block / 9240 = 453
+	// 456 ticks per line * 154 lines = 70224 ticks per frame (~59.7Hz)
 
-	const int lyTicksMax = 453; // ~60Hz * 154
+	scheduler_.Schedule(lineEvent_, deadline + lineTicks_);
+	lineStart_ = deadline;
 
-	lyTicks_ += ticksPassed;
+	// Increase LY.
+	ly_++;
+	if (ly_ == 154) {
+		ly_ = 0;
+		if (frameOutput_) DrawDebug();
+	}
 
-	while (lyTicks_ > lyTicksMax)
-	{
-		lyTicks_ -= lyTicksMax;
+	// Update display.
+	if (ly_ == 0) {
+		frameOutput_ = !outputSuppressed_;
+	}
+	if (frameOutput_) {
+		DrawLine(ly_);
+	}
+	if (ly_ == 144 && frameOutput_) {
+		displayBitmap_.SubmitFrame(frame_.data());
+	}
 
-		// Increase LY.
-		ly_++;
-		if (ly_ == 154) {
-			ly_ = 0;
-			DrawDebug();
-		}
+	// Raise VBLANK interrupt?
+	if (ly_ == 144) {
+		pic_.RaiseInterrupts(INT_VBLANK);
+	}
 
-		// Update display.
-		if (ly_ == 0) {
-			displayBitmap_.Clear();
-		}
-		DrawLine(ly_);
-		if (ly_ == 144) {
-			displayBitmap_.Present();
-		}
+	// Raise Coincidence interrupt? The flag itself is computed on read.
+	if (ly_ == lyc_ && (lcds_ & 0x40)) {
+		pic_.RaiseInterrupts(INT_LCDC);
+	}
+}
 
-		// Raise VBLANK interrupt?
-		if (ly_ == 144) {
-			pic_.RaiseInterrupts(INT_VBLANK);
-		}
+uint8_t Display::GetLy() const
+{
+	const uint64_t lines = (scheduler_.GetNow() - lineStart_) / lineTicks_;
+	return static_cast<uint8_t>((ly_ + lines) % 154);
+}
 
-		// Raise Coincidence interrupt?
-		if (ly_ == lyc_)
-		{
-			lcds_ |= 0x4; // Set Coincidence Flag
+uint8_t Display::GetMode() const
+{
+	// 0: HBLANK, 1: VBLANK, 2: OAM search, 3: transfer to LCD
+	if (GetLy() >= 144) return 1;
 
-			if (lcds_ & 0x40) {
-				pic_.RaiseInterrupts(INT_LCDC);
-			}
-		}
-		else
-		{
-			lcds_ &= ~0x4; // Clear Coincidence Flag
-		}
-	}
+	const uint64_t position = (scheduler_.GetNow() - lineStart_) % lineTicks_;
+	if (position < oamTicks_) return 2;
+	if (position < oamTicks_ + transferTicks_) return 3;
+	return 0;
+}
+
+uint8_t Display::GetStatus() const
+{
+	const uint8_t coincidence = (GetLy() == lyc_) ? 0x4 : 0;
+	return (lcds_ & 0x78) | coincidence | GetMode();
+}
+
+void Display::UpdatePalette()
+{
+	static constexpr uint8_t shades[4] = { 255, 170, 85, 0 };
+
+	for (int c = 0; c < 4; c++)
+		bgpColors_[c] = shades[(bgp_ >> (c * 2)) & 0x03];
 }
 
 void Display::DrawLine(uint8_t y)
 {
 	if (y > 143) return;
 
-	// Background
+	const int width = GetWidth();
+	const uint8_t * const vram = vram_.GetData();
+
+	// Pixels nothing is drawn to stay white.
+	uint8_t * const line = &frame_[y * width];
+	memset(line, 255, width);
+
+	// Background, only the 21 tiles that can be visible with SCX.
+	// TODO scy
+	assert(!scy_);
+
 	if (lcdc_ & 0x01)
 	{
 		const uint16_t backgroundTileMapBase = (lcdc_ & 0x08) ? 0x1C00 : 0x1800;
+		const uint8_t * const tileMap = vram + backgroundTileMapBase + (y / 8) * 32;
+		const uint8_t lineOffsetY = y % 8;
 
-		uint8_t tileY = y / 8;
-		uint8_t lineOffsetY = y % 8;
+		uint8_t indices[21 * 8];
 
-		for (uint8_t tileX = 0; tileX < 32; tileX++) {
+		for (int i = 0; i < 21; i++)
+		{
+			const uint8_t index = tileMap[((scx_ >> 3) + i) & 31];
 
-			uint8_t tile = vram_.Read(backgroundTileMapBase + tileY * 32 + tileX);
+			const uint8_t * const tile = vram_.GetTile((lcdc_ & 0x10)
+				? index
+				: 256 + static_cast<int8_t>(index));
 
-			DrawLineBackgroundTile(tile, tileX * 8, tileY * 8, lineOffsetY);
+			memcpy(&indices[i * 8], tile + lineOffsetY * 8, 8);
 		}
+
+		const uint8_t *first = &indices[scx_ & 7];
+		for (int x = 0; x < width; x++)
+			line[x] = bgpColors_[first[x]];
 	}
 
 	// Sprites
@@ -153,10 +245,7 @@ void Display::DrawLine(uint8_t y)
 
 		for (uint16_t index = 0; index < 40; index++)
 		{
-			uint8_t d[4];
-
-			for (uint16_t i = 0; i<4; i++)
-				d[i] = oam_.Read(index * 4 + i);
+			const uint8_t *d = &oam_.GetData()[index * 4];
 
 			uint8_t spriteY = d[0] - 16u;
 			uint8_t spriteX = d[1] - 8u;
@@ -164,107 +253,39 @@ void Display::DrawLine(uint8_t y)
 			uint8_t spriteFlags = d[3];
 
 			// Off screen?
-			//if (spriteX >= 144u) continue;
-			if (y - spriteY >= 8u) continue;
+			if (static_cast<unsigned>(y - spriteY) >= 8) continue;
 
 			uint8_t lineOffsetY = y - spriteY;
-			assert(lineOffsetY < 8u);
-
-			DrawLineSpriteTile(spriteIndex, spriteX, spriteY, spriteFlags, lineOffsetY);
-		}
-	}
-}
-
-void Display::DrawLineBackgroundTile(uint8_t index, uint8_t x, uint8_t y, uint8_t lineOffsetY)
-{
-	uint16_t tileDataOffset = 0;
-
-	if (lcdc_ & 0x10)
-	{
-		tileDataOffset += index * 16;
-	}
-	else
-	{
-		//tileDataOffset = 0x0800;
-		tileDataOffset = 0x1000;
-		int8_t signedIndex = reinterpret_cast<int8_t&>(index);
-		tileDataOffset += signedIndex * 16;
-	}
-
-	DrawLineTile(tileDataOffset, x, y, lineOffsetY, false, false, false, true, true);
-}
-
-void Display::DrawLineSpriteTile(uint8_t index, uint8_t x, uint8_t y, uint8_t flags, uint8_t lineOffsetY)
-{
-	uint16_t tileDataOffset = index * 16;
-
-	bool flipX = flags & 0x20;
-	bool flipY = flags & 0x40;
-
-	// TODO palette number.
-
-	DrawLineTile(tileDataOffset, x, y, lineOffsetY, true, flipX, flipY, false, false);
-}
-
-void Display::DrawLineTile(uint16_t tileDataOffset, uint8_t destX, uint8_t destY, uint8_t lineOffsetY, bool ignore0, bool flipX, bool flipY, bool scrollX, bool scrollY)
-{
-	uint8_t tileData[16];
-	for (int i = 0; i < 16; i++)
-		tileData[i] = vram_.Read(tileDataOffset + i);
-
-	uint8_t colors[4];
-	colors[3] = bgp_ >> 6;
-	colors[2] = (bgp_ & 0x30) >> 4;
-	colors[1] = (bgp_ & 0x0C) >> 2;
-	colors[0] = (bgp_ & 0x03);
-
-	uint8_t y = lineOffsetY;
-
-	// TODO scy
-	assert(!scy_);
-
-	for (uint8_t x = 0; x < 8; x++)
-	{
-		uint8_t targetX = destX + x;
 
-		if (scrollX) targetX -= scx_;
+			// TODO flipY, palette number.
+			const bool flipX = spriteFlags & 0x20;
 
-		if (targetX >= 160) continue;
+			const uint8_t * const tile = vram_.GetTile(spriteIndex);
+			const uint8_t * const indices = tile + lineOffsetY * 8;
 
-		uint8_t c = 0;
+			for (uint8_t x = 0; x < 8; x++)
+			{
+				const uint8_t c = indices[flipX ? 7 - x : x];
 
-		if (flipX)
-		{
-			if (tileData[y * 2 + 0] & (0x01 << x)) c += 1;
-			if (tileData[y * 2 + 1] & (0x01 << x)) c += 2;
-		}
-		else
-		{
-			if (tileData[y * 2 + 0] & (0x80 >> x)) c += 1;
-			if (tileData[y * 2 + 1] & (0x80 >> x)) c += 2;
-		}
+				// Must ignore color=0 for sprites.
+				if (!c) continue;
 
-		// Must ignore color=0 for sprites.
-		if (!c && ignore0) continue;
+				const uint8_t targetX = spriteX + x;
+				if (targetX >= width) continue;
 
-		uint8_t brightness = 0;
-		switch (colors[c])
-		{
-		case 0: brightness = 255; break;
-		case 1: brightness = 170; break;
-		case 2: brightness = 85; break;
-		case 3: brightness = 0; break;
+				line[targetX] = bgpColors_[c];
+			}
 		}
-
-		displayBitmap_.DrawPixel(targetX, destY + y, brightness);
 	}
+
+	displayBitmap_.SubmitLine(y, line);
 }
 
 void Display::DrawDebug()
 {
 	if (!debugBitmap_) return;
 
-	debugBitmap_->Clear();
+	debugFrame_.fill(255);
 
 	// Background
 	if (lcdc_ & 0x01)
@@ -304,84 +325,54 @@ void Display::DrawDebug()
 		}
 	}
 
-	debugBitmap_->Present();
+	debugBitmap_->SubmitFrame(debugFrame_.data());
 }
 
 void Display::DrawDebugBackgroundTile(uint8_t index, uint8_t x, uint8_t y)
 {
-	uint16_t tileDataOffset = 0;
-
-	if (lcdc_ & 0x10)
-	{
-		tileDataOffset += index * 16;
-	}
-	else
-	{
-		//tileDataOffset = 0x0800;
-		tileDataOffset = 0x1000;
-		int8_t signedIndex = reinterpret_cast<int8_t&>(index);
-		tileDataOffset += signedIndex * 16;
-	}
+	const uint16_t tile = (lcdc_ & 0x10)
+		? index
+		: 256 + static_cast<int8_t>(index);
 
-	DrawDebugTile(tileDataOffset, x, y, false, false, false);
+	DrawDebugTile(tile, x, y, false, false, false);
 }
 
 void Display::DrawDebugSpriteTile(uint8_t index, uint8_t x, uint8_t y, uint8_t flags)
 {
-	uint16_t tileDataOffset = index * 16;
-
 	bool flipX = flags & 0x20;
 	bool flipY = flags & 0x40;
 
 	// TODO palette number.
 
-	DrawDebugTile(tileDataOffset, x, y, true, flipX, flipY);
+	DrawDebugTile(index, x, y, true, flipX, flipY);
 }
 
-void Display::DrawDebugTile(uint16_t tileDataOffset, uint8_t destX, uint8_t destY, bool ignore0, bool flipX, bool flipY)
+void Display::DrawDebugTile(uint16_t tile, uint8_t destX, uint8_t destY, bool ignore0, bool flipX, bool flipY)
 {
-	uint8_t tileData[16];
-	for (int i = 0; i < 16; i++)
-		tileData[i] = vram_.Read(tileDataOffset + i);
-
-	uint8_t colors[4];
-	colors[3] = bgp_ >> 6;
-	colors[2] = (bgp_ & 0x30) >> 4;
-	colors[1] = (bgp_ & 0x0C) >> 2;
-	colors[0] = (bgp_ & 0x03);
+	const uint8_t * const indices = vram_.GetTile(tile);
 
 	for (uint8_t y = 0; y < 8; y++)
 	{
 		for (uint8_t x = 0; x < 8; x++)
 		{
-			uint8_t c = 0;
-
-			if (flipX)
-			{
-				if (tileData[y * 2 + 0] & (0x01 << x)) c += 1;
-				if (tileData[y * 2 + 1] & (0x01 << x)) c += 2;
-			}
-			else
-			{
-				if (tileData[y * 2 + 0] & (0x80 >> x)) c += 1;
-				if (tileData[y * 2 + 1] & (0x80 >> x)) c += 2;
-			}
+			const uint8_t c = indices[y * 8 + (flipX ? 7 - x : x)];
 
 			// Must ignore color=0 for sprites.
 			if (!c && ignore0) continue;
 
-			uint8_t brightness = 0;
-			switch (colors[c])
-			{
-			case 0: brightness = 255; break;
-			case 1: brightness = 170; break;
-			case 2: brightness = 85; break;
-			case 3: brightness = 0; break;
-			}
-
-			debugBitmap_->DrawPixel(destX + x, destY + y, brightness);
+			DrawDebugPixel(destX + x, destY + y, bgpColors_[c]);
 		}
 	}
 }
 
+void Display::DrawDebugPixel(uint8_t x, uint8_t y, uint8_t color)
+{
+	// The debug view draws the whole 256x256 map, only the top left
+	// part fits into the frame.
+	if (x >= GetWidth()) return;
+	if (y >= GetHeight()) return;
+
+	debugFrame_[y * GetWidth() + x] = color;
+}
+
 }
\ No newline at end of file
@@ -11,7 +11,10 @@ namespace GBEmu::Emulator
 
 class IO;
 class Pic;
-class Ram;
+class Scheduler;
+class StateWriter;
+class StateReader;
+class Vram;
 
 class SpriteAttributeTable : public MemoryRegion
 {
@@ -23,25 +26,34 @@ public:
 	virtual uint8_t Read(uint16_t offset) override;
 	virtual void Write(uint16_t offset, uint8_t data) override;
 
+	const uint8_t *GetData() const { return table_.data(); }
+
+	void SaveState(StateWriter &writer) const;
+	void LoadState(StateReader &reader);
+
 private:
 	static constexpr size_t size_ = 160;
 	std::array<uint8_t, size_> table_;
 };
 
+// Receives the rendered picture as brightness values (255 is white),
+// one byte per pixel, Display::GetWidth() pixels per line.
 class DisplayBitmap
 {
 public:
-	virtual void Clear() = 0;
-	virtual void DrawPixel(uint8_t x, uint8_t y, uint8_t color) = 0;
-	virtual void Present() = 0;
+	// Called for each line as soon as it is rendered, for bitmaps that
+	// want to process the picture while it is being drawn.
+	virtual void SubmitLine(uint8_t y, const uint8_t *shades) { }
+
+	// Called with the complete frame of Display::GetHeight() lines at the
+	// start of VBLANK. The frame is only valid during the call.
+	virtual void SubmitFrame(const uint8_t *frame) = 0;
 };
 
 class Display
 {
 public:
-	Display(IO &io, Pic &pic, Ram &vram, SpriteAttributeTable &oam, DisplayBitmap *debugBitmap, DisplayBitmap &displayBitmap);
-	
-	void Tick(int ticksPassed);
+	Display(IO &io, Pic &pic, Scheduler &scheduler, Vram &vram, SpriteAttributeTable &oam, DisplayBitmap *debugBitmap, DisplayBitmap &displayBitmap);
 
 	static void GetSize(int *width, int *height)
 	{
@@ -52,26 +64,59 @@ public:
 	static int GetWidth() { return 160; }
 	static int GetHeight() { return 144; }
 
+	// 154 lines, including the 10 VBLANK lines.
+	static constexpr int GetFrameTicks() { return lineTicks_ * 154; }
+	// Offset into the frame at which it is presented (start of VBLANK).
+	static constexpr int GetVBlankTicks() { return lineTicks_ * 144; }
+
+	// While suppressed nothing is drawn or presented. The flag is latched
+	// at the start of a frame, so a bitmap never sees a partial frame.
+	void SetOutputSuppressed(bool suppressed) { outputSuppressed_ = suppressed; }
+
+	void SaveState(StateWriter &writer) const;
+	void LoadState(StateReader &reader);
+
 private:
+	void EndOfLine(uint64_t deadline);
+
+	// Derived from the cycle position on read, lines still ending at
+	// this cycle are counted even if their event did not fire yet.
+	uint8_t GetLy() const;
+	uint8_t GetMode() const;
+	uint8_t GetStatus() const;
+
+	void UpdatePalette();
 	void DrawLine(uint8_t y);
-	void DrawLineBackgroundTile(uint8_t index, uint8_t x, uint8_t y, uint8_t lineOffsetY);
-	void DrawLineSpriteTile(uint8_t index, uint8_t x, uint8_t y, uint8_t flags, uint8_t lineOffsetY);
-	void DrawLineTile(uint16_t tileDataOffset, uint8_t destX, uint8_t destY, uint8_t lineOffsetY, bool ignore0, bool flipX, bool flipY, bool scrollX, bool scrollY);
 
 	void DrawDebug();
 	void DrawDebugBackgroundTile(uint8_t index, uint8_t x, uint8_t y);
 	void DrawDebugSpriteTile(uint8_t index, uint8_t x, uint8_t y, uint8_t flags);
-	void DrawDebugTile(uint16_t tileDataOffset, uint8_t destX, uint8_t destY, bool ignore0, bool flipX, bool flipY);
+	void DrawDebugTile(uint16_t tile, uint8_t destX, uint8_t destY, bool ignore0, bool flipX, bool flipY);
+	void DrawDebugPixel(uint8_t x, uint8_t y, uint8_t color);
 
 private:
 	IO &io_;
 	Pic &pic_;
-	Ram &vram_;
+	Scheduler &scheduler_;
+	Vram &vram_;
 	SpriteAttributeTable &oam_;
 	DisplayBitmap *debugBitmap_;
 	DisplayBitmap &displayBitmap_;
 
-	int lyTicks_;
+	static constexpr int lineTicks_ = 456;
+	// Mode 2 (OAM search) and mode 3 (transfer) lengths, mode 0 (HBLANK)
+	// takes the rest of the line.
+	static constexpr int oamTicks_ = 80;
+	static constexpr int transferTicks_ = 172;
+	int lineEvent_;
+	uint64_t lineStart_; // Cycle at which line ly_ started.
+
+	bool outputSuppressed_;
+	bool frameOutput_;
+
+	using FrameBuffer = std::array<uint8_t, 160 * 144>;
+	FrameBuffer frame_;
+	FrameBuffer debugFrame_;
 
 	uint8_t lcdc_;
 	uint8_t lcds_;
@@ -84,6 +129,7 @@ private:
 	uint8_t wy_;
 
 	uint8_t bgp_;
+	std::array<uint8_t, 4> bgpColors_; // BGP mapped to brightness
 };
 
 }
\ No newline at end of file
@@ -1,8 +1,12 @@
 #include "emulator.hh"
 #include "log.hh"
+#include "scheduler.hh"
+#include "state.hh"
+#include "rewind.hh"
 #include "memory.hh"
 #include "rom.hh"
 #include "ram.hh"
+#include "vram.hh"
 #include "io.hh"
 #include "display.hh"
 #include "sound.hh"
@@ -12,10 +16,34 @@
 #include "dma.hh"
 #include "timer.hh"
 #include "cpu.hh"
+#include "idleloop.hh"
+
+#include <cassert>
+#include <chrono>
+#include <algorithm>
+#include <limits>
 
 namespace GBEmu::Emulator
 {
 
+namespace
+{
+
+// Bump whenever any component changes what it writes.
+constexpr uint32_t stateMagic = 0x54534247; // "GBST"
+constexpr uint32_t stateVersion = 5;
+
+struct StateHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint16_t romChecksum;
+	uint16_t reserved;
+};
+
+}
+
 struct Emulator::EmulatorData
 {
 	EmulatorData(
@@ -30,12 +58,13 @@ struct Emulator::EmulatorData
 		memory(log),
 		keypad(io),
 		pic(log, io),
-		display(io, pic, vram, oam, debugBitmap, displayBitmap),
-		sound(io, soundDevice),
+		display(io, pic, scheduler, vram, oam, debugBitmap, displayBitmap),
+		sound(io, scheduler, soundDevice),
 		serial(log, io),
 		dma(io, memory),
-		timer(log, io, pic),
-		cpu(log, memory, io, pic)
+		timer(log, io, pic, scheduler),
+		cpu(log, memory, io, pic, scheduler),
+		idleLoop(memory)
 	{
 		rom.Load(romSize, romData);
 
@@ -47,10 +76,45 @@ struct Emulator::EmulatorData
 		memory.Register(&io, 0xFF00);
 	}
 
+	void SaveState(StateWriter &writer) const
+	{
+		scheduler.SaveState(writer);
+		rom.SaveState(writer);
+		ram.SaveState(writer);
+		vram.SaveState(writer);
+		extram.SaveState(writer);
+		oam.SaveState(writer);
+		io.SaveState(writer);
+		keypad.SaveState(writer);
+		pic.SaveState(writer);
+		display.SaveState(writer);
+		sound.SaveState(writer);
+		timer.SaveState(writer);
+		cpu.SaveState(writer);
+	}
+
+	void LoadState(StateReader &reader)
+	{
+		scheduler.LoadState(reader);
+		rom.LoadState(reader);
+		ram.LoadState(reader);
+		vram.LoadState(reader);
+		extram.LoadState(reader);
+		oam.LoadState(reader);
+		io.LoadState(reader);
+		keypad.LoadState(reader);
+		pic.LoadState(reader);
+		display.LoadState(reader);
+		sound.LoadState(reader);
+		timer.LoadState(reader);
+		cpu.LoadState(reader);
+	}
+
 	Log log;
+	Scheduler scheduler;
 	Rom rom;
 	Ram ram;
-	Ram vram;
+	Vram vram;
 	Ram extram;
 	SpriteAttributeTable oam;
 	IO io;
@@ -63,6 +127,7 @@ struct Emulator::EmulatorData
 	Dma dma;
 	Timer timer;
 	Cpu cpu;
+	IdleLoopDetector idleLoop;
 };
 
 Emulator::Emulator(
@@ -75,35 +140,220 @@ Emulator::Emulator(
 		std::make_unique<EmulatorData>(logFileName, romSize, romData, debugBitmap, displayBitmap, soundDevice)
 	)
 {
+	StateWriter counter;
+	counter.Write(StateHeader {});
+	counter.Write(targetTicks_);
+	emulatorData_->SaveState(counter);
+	stateSize_ = counter.GetPosition();
 }
 
 Emulator::~Emulator()
 {
 }
 
-void Emulator::Tick(double dt, const KeypadKeys &keys)
+void Emulator::SetKeys(const KeypadKeys &keys)
 {
-	const double targetTicksPerSecond = 4194304.0; // 4.194304MHz CPU Clock
-	const int targetTicksThisFrame = (int)(dt * targetTicksPerSecond); // 69905 @ 60 FPS
-	const int cpuCyclesPerBatch = 4;
+	emulatorData_->keypad.SetKeys(keys);
+}
 
-	// Run emulator ticks.
-	int executedTicks = 0;
+uint64_t Emulator::RunCycles(uint64_t cycles)
+{
+	Scheduler &scheduler = emulatorData_->scheduler;
+	Cpu &cpu = emulatorData_->cpu;
+	const Pic &pic = emulatorData_->pic;
+
+	// The cpu runs until the next peripheral deadline, peripherals are only
+	// touched by their scheduler events or when the cpu accesses their registers.
+	const uint64_t startTicks = scheduler.GetNow();
+	targetTicks_ += cycles;
+	cpu.SetRunLimit(targetTicks_);
+
+	// Ticking a halted cpu is only logged, not needed otherwise.
+	const bool haltLogged = emulatorData_->log.StateEnabled();
+
+	while (scheduler.GetNow() < targetTicks_)
 	{
-		while(executedTicks < targetTicksThisFrame)
+		if (cpu.IsHalted() && !pic.InterruptsPending() && !haltLogged)
+		{
+			// Only an interrupt wakes the cpu up, and nothing but a scheduler
+			// event raises one while it is halted. Go straight to the next.
+			const uint64_t limit = std::min(scheduler.GetNextDeadline(), targetTicks_);
+			scheduler.Advance(static_cast<uint32_t>(std::min<uint64_t>(
+				limit - scheduler.GetNow(), std::numeric_limits<uint32_t>::max())));
+		}
+		else if (idleLoopSkipping_)
 		{
-			int batchTicks = 0;
-			for (int cpuCycle = 0; cpuCycle < cpuCyclesPerBatch; cpuCycle++)
-				batchTicks += emulatorData_->cpu.Tick();
-			executedTicks += batchTicks;
-
-			emulatorData_->keypad.SetKeys(keys);
-			emulatorData_->display.Tick(batchTicks);
-			emulatorData_->timer.Tick(batchTicks);
-			emulatorData_->sound.Tick(batchTicks);
+			// Idle loops end with a jump backwards.
+			scheduler.Advance(cpu.Tick());
+
+			const uint16_t branch = cpu.GetInstructionPc();
+			if (cpu.GetPc() < branch)
+				SkipIdleLoop(branch);
+		}
+		else
+		{
+			scheduler.Advance(cpu.Tick());
+		}
+
+		if (scheduler.GetNow() >= scheduler.GetNextDeadline())
+		{
+			scheduler.Dispatch();
+			emulatorData_->idleLoop.Reset();
+
+			// Frame boundaries always coincide with a line event.
+			if (scheduler.GetNow() >= rewindCaptureTicks_)
+				CaptureRewindState();
 		}
 	}
 
+	return scheduler.GetNow() - startTicks;
+}
+
+void Emulator::SkipIdleLoop(uint16_t branch)
+{
+	Scheduler &scheduler = emulatorData_->scheduler;
+
+	// Skipped instructions would be missing from the log.
+	if (emulatorData_->log.InstructionEnabled())
+		return;
+
+	const uint64_t now = scheduler.GetNow();
+	const uint32_t iteration = emulatorData_->idleLoop.OnBackwardJump(branch, emulatorData_->cpu.GetRegisters(), now);
+	if (!iteration)
+		return;
+
+	// Whole iterations only, and stop short of the deadline: the cpu
+	// then runs into it on the same instruction it would have anyway.
+	const uint64_t limit = std::min(scheduler.GetNextDeadline(), targetTicks_);
+	if (limit <= now)
+		return;
+
+	const uint64_t span = std::min<uint64_t>(limit - now - 1, std::numeric_limits<uint32_t>::max());
+	const uint64_t iterations = span / iteration;
+	if (!iterations)
+		return;
+
+	const uint64_t skipped = iterations * iteration;
+	scheduler.Advance(static_cast<uint32_t>(skipped));
+
+	idleLoopStats_.skips++;
+	idleLoopStats_.skippedCycles += skipped;
+}
+
+void Emulator::SetIdleLoopSkipping(bool enabled)
+{
+	idleLoopSkipping_ = enabled;
+	emulatorData_->idleLoop.Reset();
+}
+
+bool Emulator::IsJitAvailable()
+{
+#ifdef GBEMU_JIT
+	return true;
+#else
+	return false;
+#endif
+}
+
+void Emulator::SetJitEnabled(bool enabled)
+{
+	emulatorData_->cpu.SetJitEnabled(enabled);
+}
+
+uint64_t Emulator::RunFrames(int frames)
+{
+	assert(frames >= 0);
+
+	return RunCycles(static_cast<uint64_t>(frames) * Display::GetFrameTicks());
+}
+
+uint64_t Emulator::GetCycles() const
+{
+	return emulatorData_->scheduler.GetNow();
+}
+
+size_t Emulator::SaveState(void *buffer, size_t size) const
+{
+	if (!buffer || size < stateSize_)
+		return 0;
+
+	const StateHeader header = {
+		stateMagic,
+		stateVersion,
+		static_cast<uint32_t>(stateSize_),
+		emulatorData_->rom.GetChecksum(),
+		0,
+	};
+
+	StateWriter writer(buffer, size);
+	writer.Write(header);
+	writer.Write(targetTicks_);
+	emulatorData_->SaveState(writer);
+
+	assert(!writer.Failed());
+	assert(writer.GetPosition() == stateSize_);
+
+	return writer.GetPosition();
+}
+
+bool Emulator::LoadState(const void *buffer, size_t size)
+{
+	if (!RestoreState(buffer, size))
+		return false;
+
+	// The history belongs to a different timeline now.
+	if (rewindBuffer_) {
+		rewindBuffer_->Clear();
+		CaptureRewindState();
+	}
+
+	return true;
+}
+
+bool Emulator::RestoreState(const void *buffer, size_t size)
+{
+	if (!buffer || size < stateSize_)
+		return false;
+
+	StateReader reader(buffer, size);
+
+	StateHeader header;
+	reader.Read(header);
+
+	// Check everything up front, components can not fail halfway.
+	if (header.magic != stateMagic ||
+		header.version != stateVersion ||
+		header.size != stateSize_ ||
+		header.romChecksum != emulatorData_->rom.GetChecksum())
+		return false;
+
+	// The run target is part of the state, so the overshoot of the last
+	// instruction carries over the same way and replays are deterministic.
+	reader.Read(targetTicks_);
+	emulatorData_->LoadState(reader);
+	emulatorData_->idleLoop.Reset();
+
+	assert(!reader.Failed());
+	assert(reader.GetPosition() == stateSize_);
+
+	return true;
+}
+
+void Emulator::Tick(double dt, const KeypadKeys &keys)
+{
+	const double targetTicksPerSecond = 4194304.0; // 4.194304MHz CPU Clock
+	const uint64_t targetTicksThisFrame = (uint64_t)(dt * targetTicksPerSecond); // 69905 @ 60 FPS
+
+	// Run emulator ticks.
+	SetKeys(keys);
+	const uint64_t executedTicks = runAheadFrames_
+		? RunAhead(targetTicksThisFrame)
+		: RunCycles(targetTicksThisFrame);
+
+	// Hand the frame's audio to the device now instead of when the
+	// current block is complete, that is what keeps the latency low.
+	emulatorData_->sound.Flush();
+
 	// Stats
 	{
 		statTime_ += dt;
@@ -117,13 +367,176 @@ void Emulator::Tick(double dt, const KeypadKeys &keys)
 
 			printf("Emulation speed error %0.3f%%\n", relError);
 
+			if (statRunAheadFrames_)
+				printf("Run-ahead %d frames: %.3f ms overhead per frame\n",
+					runAheadFrames_, statRunAheadTime_ * 1000.0 / statRunAheadFrames_);
+
+			if (idleLoopSkipping_)
+				printf("Idle loops: %llu cycles skipped\n",
+					static_cast<unsigned long long>(idleLoopStats_.skippedCycles - statSkippedCycles_));
+
 			// printf("dt %.3lf ticks %d tps %.3lf absError %.3lf relError %.3lf%%\n",
 			// 	statTime_, statTicks_, ticksPerSecond, absError, relError*100.0);
 
 			statTime_ = 0;
 			statTicks_ = 0;
+			statRunAheadTime_ = 0;
+			statRunAheadFrames_ = 0;
+			statSkippedCycles_ = idleLoopStats_.skippedCycles;
 		}
 	}
 }
 
+void Emulator::SetRunAhead(int frames)
+{
+	assert(frames >= 0);
+
+	runAheadFrames_ = frames;
+	runAheadDebt_ = 0;
+	runAheadState_.resize(frames ? stateSize_ : 0);
+
+	emulatorData_->display.SetOutputSuppressed(false);
+}
+
+uint64_t Emulator::RunAhead(uint64_t ticks)
+{
+	Display &display = emulatorData_->display;
+	Sound &sound = emulatorData_->sound;
+
+	const uint64_t frameTicks = Display::GetFrameTicks();
+	const uint64_t vblankTicks = Display::GetVBlankTicks();
+
+	// The real timeline only ever stops at the start of VBLANK, right
+	// after a frame was presented, so every frame run ahead from there
+	// is drawn from its first line on. Its own frames are not shown.
+	runAheadDebt_ += ticks;
+	const uint64_t due = targetTicks_ + runAheadDebt_;
+	if (due < vblankTicks)
+		return 0;
+
+	const uint64_t target = (due - vblankTicks) / frameTicks * frameTicks + vblankTicks;
+	if (target <= targetTicks_)
+		return 0;
+
+	runAheadDebt_ = due - target;
+
+	display.SetOutputSuppressed(true);
+	const uint64_t executedTicks = RunCycles(target - targetTicks_);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	// Frames ahead are not heard and do not end up in the rewind history.
+	// Suppressing the sound renders the samples of the real timeline,
+	// so they are not rendered again after the state is restored.
+	sound.SetOutputSuppressed(true);
+
+	SaveState(runAheadState_.data(), runAheadState_.size());
+
+	const uint64_t rewindCaptureTicks = rewindCaptureTicks_;
+	rewindCaptureTicks_ = std::numeric_limits<uint64_t>::max();
+
+	RunCycles((runAheadFrames_ - 1) * frameTicks);
+	display.SetOutputSuppressed(false);
+	RunCycles(frameTicks);
+
+	const bool restored = RestoreState(runAheadState_.data(), runAheadState_.size());
+	assert(restored);
+	(void)restored;
+
+	sound.SetOutputSuppressed(false);
+	rewindCaptureTicks_ = rewindCaptureTicks;
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	statRunAheadTime_ += std::chrono::duration<double>(end - start).count();
+	statRunAheadFrames_++;
+
+	return executedTicks;
+}
+
+void Emulator::EnableRewind(int intervalFrames, size_t memoryBudget)
+{
+	assert(intervalFrames > 0);
+
+	rewindInterval_ = intervalFrames;
+	rewindBuffer_ = std::make_unique<RewindBuffer>(stateSize_, memoryBudget);
+	rewindState_.resize(stateSize_);
+
+	CaptureRewindState();
+}
+
+void Emulator::DisableRewind()
+{
+	rewindBuffer_.reset();
+	rewindState_.clear();
+	rewindState_.shrink_to_fit();
+	rewindInterval_ = 0;
+
+	UpdateRewindCapture();
+}
+
+void Emulator::SetRewindMemoryBudget(size_t memoryBudget)
+{
+	if (rewindBuffer_)
+		rewindBuffer_->SetMemoryBudget(memoryBudget);
+}
+
+int Emulator::RewindFrames(int frames)
+{
+	assert(frames >= 0);
+
+	if (!rewindBuffer_ || rewindBuffer_->IsEmpty())
+		return 0;
+
+	const uint64_t frameTicks = Display::GetFrameTicks();
+	const uint64_t now = emulatorData_->scheduler.GetNow();
+	const uint64_t back = static_cast<uint64_t>(frames) * frameTicks;
+	const uint64_t target = now > back ? now - back : 0;
+
+	// The state we end up at stays in the buffer, rewinding
+	// again continues from there.
+	while (rewindBuffer_->GetCount() > 1 && rewindBuffer_->GetNewestCycle() > target)
+		rewindBuffer_->DropNewest();
+
+	const bool restored = RestoreState(rewindBuffer_->GetNewest(), stateSize_);
+	assert(restored);
+	(void)restored;
+
+	UpdateRewindCapture();
+
+	const uint64_t rewound = now - emulatorData_->scheduler.GetNow();
+	return static_cast<int>((rewound + frameTicks / 2) / frameTicks);
+}
+
+size_t Emulator::GetRewindMemoryUsage() const
+{
+	return rewindBuffer_ ? rewindBuffer_->GetMemoryUsage() : 0;
+}
+
+size_t Emulator::GetRewindStateCount() const
+{
+	return rewindBuffer_ ? rewindBuffer_->GetCount() : 0;
+}
+
+void Emulator::CaptureRewindState()
+{
+	assert(rewindBuffer_);
+
+	SaveState(rewindState_.data(), rewindState_.size());
+	rewindBuffer_->Push(emulatorData_->scheduler.GetNow(), rewindState_.data());
+
+	UpdateRewindCapture();
+}
+
+void Emulator::UpdateRewindCapture()
+{
+	if (!rewindBuffer_) {
+		rewindCaptureTicks_ = std::numeric_limits<uint64_t>::max();
+		return;
+	}
+
+	// Capture on every intervalFrames-th frame boundary.
+	const uint64_t intervalTicks = static_cast<uint64_t>(rewindInterval_) * Display::GetFrameTicks();
+	rewindCaptureTicks_ = (emulatorData_->scheduler.GetNow() / intervalTicks + 1) * intervalTicks;
+}
+
 }
\ No newline at end of file
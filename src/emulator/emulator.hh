@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstdint>
+#include <limits>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "keypad.hh"
 
@@ -10,6 +13,7 @@ namespace GBEmu::Emulator
 
 class DisplayBitmap;
 class SoundDevice;
+class RewindBuffer;
 
 class Emulator
 {
@@ -22,15 +26,98 @@ public:
 		SoundDevice &soundDevice);
 	virtual ~Emulator();
 
+	// Runs the emulator for dt seconds of emulated time, used by the
+	// SDL main loop.
 	void Tick(double dt, const KeypadKeys &keys);
 
+	// Unpaced execution, returns the number of ticks actually run.
+	// Overshoot of the last instruction is taken off the next call.
+	void SetKeys(const KeypadKeys &keys);
+	uint64_t RunCycles(uint64_t cycles);
+	uint64_t RunFrames(int frames);
+
+	uint64_t GetCycles() const;
+
+	// Save states are a flat, versioned binary blob of a fixed size.
+	// SaveState() returns the number of bytes written, 0 if the buffer
+	// is too small. LoadState() rejects states of other versions or ROMs.
+	// Neither allocates.
+	size_t GetStateSize() const { return stateSize_; }
+	size_t SaveState(void *buffer, size_t size) const;
+	bool LoadState(const void *buffer, size_t size);
+
+	// Rewind keeps a save state every intervalFrames frames, using at most
+	// memoryBudget bytes (the oldest states are dropped first).
+	// RewindFrames() goes back to the newest state that is at least
+	// frames old, or the oldest one there is, and returns the number of
+	// frames actually rewound. Loading a state clears the history.
+	void EnableRewind(int intervalFrames, size_t memoryBudget);
+	void DisableRewind();
+	void SetRewindMemoryBudget(size_t memoryBudget);
+	int RewindFrames(int frames);
+	size_t GetRewindMemoryUsage() const;
+	size_t GetRewindStateCount() const;
+
+	// Run-ahead hides input latency: after each Tick() the emulator runs
+	// frames ahead with the current keys, presents the last of them and
+	// restores its state. The real timeline is only heard, not shown.
+	// Costs frames extra emulated frames per frame, 0 disables it.
+	void SetRunAhead(int frames);
+	int GetRunAhead() const { return runAheadFrames_; }
+
+	// Loops that only wait for a peripheral (polling LY, IF or a flag set
+	// by an interrupt handler) are fast-forwarded to the next scheduler
+	// event instead of being interpreted. The result is cycle exact, but
+	// it is on by default and can be turned off per ROM all the same.
+	void SetIdleLoopSkipping(bool enabled);
+	bool GetIdleLoopSkipping() const { return idleLoopSkipping_; }
+
+	struct IdleLoopStats
+	{
+		uint64_t skips;         // Number of times a loop was fast-forwarded.
+		uint64_t skippedCycles; // Cycles not interpreted because of it.
+	};
+
+	IdleLoopStats GetIdleLoopStats() const { return idleLoopStats_; }
+
+	// Builds with -DGBEMU_JIT run blocks as x86-64 code. Disabling it
+	// interprets them instead, the reference gbemu_headless --check-jit
+	// compares against.
+	static bool IsJitAvailable();
+	void SetJitEnabled(bool enabled);
+
 private:
+	uint64_t RunAhead(uint64_t ticks);
+	void SkipIdleLoop(uint16_t branch);
+
+	bool RestoreState(const void *buffer, size_t size);
+	void CaptureRewindState();
+	void UpdateRewindCapture();
+
 	struct EmulatorData;
 	const std::unique_ptr<EmulatorData> emulatorData_;
 
+	uint64_t targetTicks_ = 0;
+	size_t stateSize_ = 0;
+
+	std::unique_ptr<RewindBuffer> rewindBuffer_;
+	std::vector<uint8_t> rewindState_;
+	int rewindInterval_ = 0;
+	uint64_t rewindCaptureTicks_ = std::numeric_limits<uint64_t>::max();
+
+	bool idleLoopSkipping_ = true;
+	IdleLoopStats idleLoopStats_ = {};
+
+	int runAheadFrames_ = 0;
+	uint64_t runAheadDebt_ = 0;
+	std::vector<uint8_t> runAheadState_;
+
 	bool statFirstCall_ = true;
 	double statTime_ = 0;
 	int statTicks_ = 0;
+	double statRunAheadTime_ = 0;
+	int statRunAheadFrames_ = 0;
+	uint64_t statSkippedCycles_ = 0;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include "idleloop.hh"
+#include "memory.hh"
+
+#include <cstring>
+
+namespace GBEmu::Emulator
+{
+
+IdleLoopDetector::IdleLoopDetector(Memory &memory)
+	:memory_(memory),
+	valid_(false),
+	idle_(false),
+	start_(0),
+	branch_(0),
+	regs_({}),
+	visit_(0)
+{
+}
+
+uint32_t IdleLoopDetector::OnBackwardJump(uint16_t branch, const Registers &regs, uint64_t now)
+{
+	const uint16_t start = regs.pc;
+
+	// The analysis is kept for as long as the cpu stays in the same
+	// loop, also when it was not idle: busy loops jump back all the time.
+	if (!valid_ || start != start_ || branch != branch_)
+	{
+		valid_ = true;
+		idle_ = IsIdleLoop(start, branch, regs);
+		start_ = start;
+		branch_ = branch;
+		regs_ = regs;
+		visit_ = now;
+		return 0;
+	}
+
+	if (!idle_)
+		return 0;
+
+	// Only the cpu ran since the last visit, and it only read memory
+	// which did not change. If it ended up in the same state, the next
+	// iteration is going to be the same again.
+	const bool same = !memcmp(&regs, &regs_, sizeof(Registers));
+	const uint64_t iteration = now - visit_;
+
+	regs_ = regs;
+	visit_ = now;
+
+	return same ? static_cast<uint32_t>(iteration) : 0;
+}
+
+bool IdleLoopDetector::IsIdleLoop(uint16_t start, uint16_t branch, const Registers &regs) const
+{
+	if (branch < start || branch - start >= maxBodySize_)
+		return false;
+
+	// Code in IO space could have side effects when decoded.
+	if (start < 0xFF80 && branch >= 0xFE00)
+		return false;
+
+	// The loop must be closed by a jump to its start.
+	switch (memory_.Read(branch))
+	{
+	case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR (cc,)e
+		if (static_cast<uint16_t>(branch + 2 + static_cast<int8_t>(memory_.Read(branch + 1))) != start) return false;
+		break;
+	case 0xC3: case 0xC2: case 0xCA: case 0xD2: case 0xDA: // JP (cc,)nn
+		if ((memory_.Read(branch + 1) | (memory_.Read(branch + 2) << 8)) != start) return false;
+		break;
+	default:
+		return false;
+	}
+
+	// Everything else may only read stable memory and change A and F.
+	// Branches inside the body must not go before its start, exits
+	// after its end are fine. Branches within it must land on one of
+	// the instructions checked here, not in the middle of one.
+	static_assert(maxBodySize_ <= 32, "one bit per body byte");
+	uint32_t starts = 0;
+	uint32_t targets = 0;
+
+	auto addTarget = [&](uint16_t target) {
+		if (target <= branch)
+			targets |= 1u << (target - start);
+	};
+
+	uint16_t address = start;
+
+	while (address != branch)
+	{
+		if (address > branch)
+			return false;
+
+		starts |= 1u << (address - start);
+
+		const uint8_t opcode = memory_.Read(address);
+		uint16_t target = 0;
+
+		switch (opcode)
+		{
+		case 0x00: // NOP
+		case 0x78: case 0x79: case 0x7A: case 0x7B: case 0x7C: case 0x7D: case 0x7F: // LD A,r
+		case 0xA0: case 0xA1: case 0xA2: case 0xA3: case 0xA4: case 0xA5: case 0xA7: // AND r
+		case 0xA8: case 0xA9: case 0xAA: case 0xAB: case 0xAC: case 0xAD: case 0xAF: // XOR r
+		case 0xB0: case 0xB1: case 0xB2: case 0xB3: case 0xB4: case 0xB5: case 0xB7: // OR r
+		case 0xB8: case 0xB9: case 0xBA: case 0xBB: case 0xBC: case 0xBD: case 0xBF: // CP r
+			address += 1;
+			break;
+
+		case 0x7E: case 0xA6: case 0xAE: case 0xB6: case 0xBE: // LD/AND/XOR/OR/CP A,(HL)
+			if (!IsStableAddress(regs.hl)) return false;
+			address += 1;
+			break;
+
+		case 0x0A: // LD A,(BC)
+			if (!IsStableAddress(regs.bc)) return false;
+			address += 1;
+			break;
+
+		case 0x1A: // LD A,(DE)
+			if (!IsStableAddress(regs.de)) return false;
+			address += 1;
+			break;
+
+		case 0xE6: case 0xEE: case 0xF6: case 0xFE: // AND/XOR/OR/CP n
+			address += 2;
+			break;
+
+		case 0xF0: // LDH A,(n)
+			if (!IsStableAddress(0xFF00 | memory_.Read(address + 1))) return false;
+			address += 2;
+			break;
+
+		case 0xFA: // LD A,(nn)
+			if (!IsStableAddress(memory_.Read(address + 1) | (memory_.Read(address + 2) << 8))) return false;
+			address += 3;
+			break;
+
+		case 0xCB:
+		{
+			// BIT b,r and BIT b,(HL) only set flags.
+			const uint8_t op = memory_.Read(address + 1);
+			if (op < 0x40 || op > 0x7F) return false;
+			if ((op & 0x07) == 6 && !IsStableAddress(regs.hl)) return false;
+			address += 2;
+			break;
+		}
+
+		case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR (cc,)e
+			target = address + 2 + static_cast<int8_t>(memory_.Read(address + 1));
+			if (target < start) return false;
+			addTarget(target);
+			address += 2;
+			break;
+
+		case 0xC3: case 0xC2: case 0xCA: case 0xD2: case 0xDA: // JP (cc,)nn
+			target = memory_.Read(address + 1) | (memory_.Read(address + 2) << 8);
+			if (target < start) return false;
+			addTarget(target);
+			address += 3;
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	starts |= 1u << (branch - start);
+	return !(targets & ~starts);
+}
+
+bool IdleLoopDetector::IsStableAddress(uint16_t address)
+{
+	// ROM, VRAM, WRAM (and its echo), HRAM and IE only change when the
+	// cpu writes to them.
+	if (address < 0xA000) return true;
+	if (address >= 0xC000 && address < 0xFE00) return true;
+	if (address >= 0xFF80) return true;
+
+	// IO registers which only change on writes or in scheduler events.
+	// Not DIV, TIMA or STAT, they move on with every cycle.
+	switch (address)
+	{
+	case 0xFF00: // JOYP
+	case 0xFF0F: // IF
+	case 0xFF40: // LCDC
+	case 0xFF42: // SCY
+	case 0xFF43: // SCX
+	case 0xFF44: // LY
+	case 0xFF45: // LYC
+	case 0xFF47: // BGP
+	case 0xFF4A: // WY
+	case 0xFF4B: // WX
+		return true;
+	default:
+		return false;
+	}
+}
+
+}
\ No newline at end of file
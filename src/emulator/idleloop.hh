@@ -0,0 +1,54 @@
+#pragma once
+
+#include "cpu.hh"
+
+#include <cstdint>
+
+namespace GBEmu::Emulator
+{
+
+class Memory;
+
+// Recognizes loops in which the cpu only waits for a peripheral, e.g.
+//
+//   wait: LDH A,(44h)
+//         CP 90h
+//         JR NZ,wait
+//
+// The body of such a loop is short, only reads memory that can not
+// change before the next scheduler event (the cpu itself does not write)
+// and only modifies A and the flags. Once an iteration has brought the
+// registers back to exactly where they were, every following iteration
+// up to the next event does the same, so the emulator can skip them.
+class IdleLoopDetector
+{
+public:
+	IdleLoopDetector(Memory &memory);
+
+	// Called after the cpu jumped backwards from the instruction at
+	// branch. Returns the length in cycles of the iteration that just
+	// ended if it was idle, 0 otherwise.
+	uint32_t OnBackwardJump(uint16_t branch, const Registers &regs, uint64_t now);
+
+	// Must be called whenever anything but the cpu ran, e.g. after
+	// scheduler events.
+	void Reset() { valid_ = false; }
+
+private:
+	bool IsIdleLoop(uint16_t start, uint16_t branch, const Registers &regs) const;
+	static bool IsStableAddress(uint16_t address);
+
+	// Longest loop body looked at, up to the closing jump.
+	static constexpr int maxBodySize_ = 16;
+
+	Memory &memory_;
+
+	bool valid_; // start_ and branch_ were analyzed
+	bool idle_;
+	uint16_t start_;
+	uint16_t branch_;
+	Registers regs_;
+	uint64_t visit_;
+};
+
+}
\ No newline at end of file
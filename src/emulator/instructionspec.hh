@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+
+namespace GBEmu::Emulator
+{
+
+// Declarative description of the regular blocks of the instruction set:
+// loads between 8-bit registers (40-7F), ALU operations on A (80-BF) and
+// all CB-prefixed instructions. Their operation and operands are bit
+// fields of the opcode, decoded here once at compile time. The switch
+// core instantiates one handler per opcode from these tables and
+// opcodes.cc takes the mnemonics from them.
+
+// Register field of an opcode, in encoding order.
+enum class Operand : uint8_t
+{
+	B, C, D, E, H, L, IndirectHL, A,
+};
+
+enum class Operation : uint8_t
+{
+	Invalid,
+	Ld, Halt,
+	Add, Adc, Sub, Sbc, And, Xor, Or, Cp,
+	Rlc, Rrc, Rl, Rr, Sla, Sra, Swap, Srl,
+	Bit, Res, Set,
+};
+
+struct InstructionSpec
+{
+	Operation operation;
+	Operand target;
+	Operand source;
+	uint8_t bit;
+	uint8_t ticks;
+};
+
+constexpr InstructionSpec DecodeInstruction(uint8_t opcode)
+{
+	const Operand target = Operand((opcode >> 3) & 7);
+	const Operand source = Operand(opcode & 7);
+	const bool memory = target == Operand::IndirectHL || source == Operand::IndirectHL;
+
+	// LD (HL),(HL) is HALT instead.
+	if (opcode == 0x76)
+		return { Operation::Halt, Operand::A, Operand::A, 0, 4 };
+
+	if (opcode >= 0x40 && opcode < 0x80)
+		return { Operation::Ld, target, source, 0, uint8_t(memory ? 8 : 4) };
+
+	if (opcode >= 0x80 && opcode < 0xC0)
+	{
+		const Operation operation = Operation(uint8_t(Operation::Add) + ((opcode >> 3) & 7));
+		return { operation, Operand::A, source, 0, uint8_t(source == Operand::IndirectHL ? 8 : 4) };
+	}
+
+	return { Operation::Invalid, Operand::A, Operand::A, 0, 0 };
+}
+
+// Ticks include the prefix. BIT, RES and SET on (HL) take 8 like on a
+// register, same as in the table core.
+constexpr InstructionSpec DecodeInstructionCB(uint8_t opcode)
+{
+	const Operand target = Operand(opcode & 7);
+	const uint8_t bit = (opcode >> 3) & 7;
+
+	if (opcode < 0x40)
+	{
+		const Operation operation = Operation(uint8_t(Operation::Rlc) + bit);
+		return { operation, target, target, 0, uint8_t(target == Operand::IndirectHL ? 16 : 8) };
+	}
+
+	const Operation operation = Operation(uint8_t(Operation::Bit) + (opcode >> 6) - 1);
+	return { operation, target, target, bit, 8 };
+}
+
+template<typename Decode>
+constexpr std::array<InstructionSpec, 256> MakeInstructionSpecs(Decode decode)
+{
+	std::array<InstructionSpec, 256> specs = {};
+	for (size_t opcode = 0; opcode < specs.size(); opcode++)
+		specs[opcode] = decode(uint8_t(opcode));
+	return specs;
+}
+
+inline constexpr std::array<InstructionSpec, 256> instructionSpecs = MakeInstructionSpecs(DecodeInstruction);
+inline constexpr std::array<InstructionSpec, 256> instructionSpecsCB = MakeInstructionSpecs(DecodeInstructionCB);
+
+// Mnemonics in the notation of opcodes.cc, built at compile time.
+struct Mnemonic
+{
+	std::array<char, 12> text;
+	size_t length;
+
+	constexpr void Append(const char *s)
+	{
+		while (*s)
+			text[length++] = *s++;
+		text[length] = '\0';
+	}
+};
+
+constexpr Mnemonic MakeMnemonic(const InstructionSpec &spec)
+{
+	constexpr const char *operations[] = {
+		"", "LD", "HALT",
+		"ADD", "ADC", "SUB", "SBC", "AND", "XOR", "OR", "CP",
+		"RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL",
+		"BIT", "RES", "SET",
+	};
+	constexpr const char *operands[] = { "B", "C", "D", "E", "H", "L", "(HL)", "A" };
+	constexpr const char *bits[] = { "0", "1", "2", "3", "4", "5", "6", "7" };
+
+	Mnemonic mnemonic = {};
+	mnemonic.Append(operations[size_t(spec.operation)]);
+
+	switch (spec.operation)
+	{
+	case Operation::Invalid:
+	case Operation::Halt:
+		break;
+
+	case Operation::Bit:
+	case Operation::Res:
+	case Operation::Set:
+		mnemonic.Append(" ");
+		mnemonic.Append(bits[spec.bit]);
+		mnemonic.Append(",");
+		mnemonic.Append(operands[size_t(spec.target)]);
+		break;
+
+	case Operation::Rlc:
+	case Operation::Rrc:
+	case Operation::Rl:
+	case Operation::Rr:
+	case Operation::Sla:
+	case Operation::Sra:
+	case Operation::Swap:
+	case Operation::Srl:
+		mnemonic.Append(" ");
+		mnemonic.Append(operands[size_t(spec.target)]);
+		break;
+
+	default:
+		mnemonic.Append(" ");
+		mnemonic.Append(operands[size_t(spec.target)]);
+		mnemonic.Append(",");
+		mnemonic.Append(operands[size_t(spec.source)]);
+		break;
+	}
+
+	return mnemonic;
+}
+
+constexpr std::array<Mnemonic, 256> MakeMnemonics(const std::array<InstructionSpec, 256> &specs)
+{
+	std::array<Mnemonic, 256> mnemonics = {};
+	for (size_t opcode = 0; opcode < specs.size(); opcode++)
+		mnemonics[opcode] = MakeMnemonic(specs[opcode]);
+	return mnemonics;
+}
+
+}
\ No newline at end of file
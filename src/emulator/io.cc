@@ -1,5 +1,6 @@
 #include "io.hh"
 #include "log.hh"
+#include "state.hh"
 
 #include <cstdlib>
 #include <cassert>
@@ -79,4 +80,14 @@ void IO::Register(const std::string &name, uint8_t offset, IOReadHandler read, I
 	ports_[offset].Write = write;
 }
 
+void IO::SaveState(StateWriter &writer) const
+{
+	writer.Write(ram_);
+}
+
+void IO::LoadState(StateReader &reader)
+{
+	reader.Read(ram_);
+}
+
 }
\ No newline at end of file
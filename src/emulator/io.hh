@@ -11,6 +11,8 @@ namespace GBEmu::Emulator
 {
 
 class Log;
+class StateWriter;
+class StateReader;
 
 using IOReadHandler = std::function<uint8_t()>;
 using IOWriteHandler = std::function<void(uint8_t)>;
@@ -33,6 +35,9 @@ public:
 
 	void Register(const std::string &name, uint8_t offset, IOReadHandler read, IOWriteHandler write);
 
+	void SaveState(StateWriter &writer) const;
+	void LoadState(StateReader &reader);
+
 private:
 	Log & log_;
 
@@ -0,0 +1,1220 @@
+#include "jit.hh"
+#include "cpu.hh"
+#include "memory.hh"
+#include "pic.hh"
+#include "scheduler.hh"
+#include "opcodes.hh"
+#include "instructionspec.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifdef GBEMU_JIT
+
+#include <sys/mman.h>
+
+namespace GBEmu::Emulator
+{
+
+namespace
+{
+
+// Host registers, in encoding order.
+enum HostRegister : int
+{
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+// Pinned for the whole block. All are callee saved, helpers keep them.
+constexpr int regBC = RBX;
+constexpr int regDE = RBP;
+constexpr int regHL = R13;
+constexpr int regA = R14;
+constexpr int regContext = R12;
+constexpr int regRegisters = R15;
+
+enum class Size { Byte, Word, Dword, Qword };
+
+enum class Alu : uint8_t { Add, Or, Adc, Sbb, And, Sub, Xor, Cmp };
+enum class Shift : uint8_t { Rol, Ror, Rcl, Rcr, Shl, Shr, Sal, Sar };
+
+enum class Condition : uint8_t
+{
+	Below = 0x2, AboveOrEqual = 0x3, Equal = 0x4, NotEqual = 0x5,
+};
+
+// Register, or memory at [base + disp].
+struct Rm
+{
+	bool memory;
+	int reg;
+	int32_t disp;
+};
+
+constexpr Rm Reg(int reg) { return { false, reg, 0 }; }
+constexpr Rm Mem(int base, int32_t disp) { return { true, base, disp }; }
+
+// Just the instructions the translated blocks need. Memory operands are
+// always encoded with a 32 bit displacement.
+class Assembler
+{
+public:
+	using Label = size_t;
+
+	std::vector<uint8_t> &GetCode() { return code_; }
+
+	Label NewLabel()
+	{
+		labels_.push_back(-1);
+		return labels_.size() - 1;
+	}
+
+	void Bind(Label label) { labels_[label] = code_.size(); }
+
+	// Resolves jumps, all labels must be bound.
+	void Link()
+	{
+		for (const auto &[position, label] : fixups_)
+		{
+			assert(labels_[label] >= 0);
+			const int32_t rel = int32_t(labels_[label] - int64_t(position + 4));
+			std::memcpy(&code_[position], &rel, 4);
+		}
+	}
+
+	void Byte(uint8_t b) { code_.push_back(b); }
+	void Word(uint16_t w) { Raw(&w, 2); }
+	void Dword(uint32_t d) { Raw(&d, 4); }
+	void Qword(uint64_t q) { Raw(&q, 8); }
+
+	// reg is the register field of ModRM or the opcode extension.
+	void Op(std::initializer_list<uint8_t> opcode, int reg, Rm rm, Size size)
+	{
+		if (size == Size::Word) Byte(0x66);
+
+		uint8_t rex = 0x40;
+		if (size == Size::Qword) rex |= 8;
+		if (reg >= 8) rex |= 4;
+		if (rm.reg >= 8) rex |= 1;
+
+		// Without REX 4-7 are AH, CH, DH and BH.
+		const bool byteRegister = size == Size::Byte &&
+			((reg >= 4 && reg < 8) || (!rm.memory && rm.reg >= 4 && rm.reg < 8));
+		if (rex != 0x40 || byteRegister) Byte(rex);
+
+		for (uint8_t b : opcode) Byte(b);
+
+		if (!rm.memory)
+		{
+			Byte(0xC0 | (reg & 7) << 3 | (rm.reg & 7));
+			return;
+		}
+
+		Byte(0x80 | (reg & 7) << 3 | (rm.reg & 7));
+		if ((rm.reg & 7) == RSP) Byte(0x24);
+		Dword(rm.disp);
+	}
+
+	void Mov(Rm dst, int src, Size size) { Op({ uint8_t(size == Size::Byte ? 0x88 : 0x89) }, src, dst, size); }
+	void Mov(int dst, Rm src, Size size) { Op({ uint8_t(size == Size::Byte ? 0x8A : 0x8B) }, dst, src, size); }
+	void Movzx8(int dst, Rm src) { Op({ 0x0F, 0xB6 }, dst, src, Size::Byte); }
+	void Movzx16(int dst, Rm src) { Op({ 0x0F, 0xB7 }, dst, src, Size::Dword); }
+
+	void MovImm(int dst, uint32_t imm)
+	{
+		if (dst >= 8) Byte(0x41);
+		Byte(0xB8 + (dst & 7));
+		Dword(imm);
+	}
+
+	void MovImm64(int dst, uint64_t imm)
+	{
+		Byte(dst >= 8 ? 0x49 : 0x48);
+		Byte(0xB8 + (dst & 7));
+		Qword(imm);
+	}
+
+	void MovImm(Rm dst, uint32_t imm, Size size)
+	{
+		Op({ uint8_t(size == Size::Byte ? 0xC6 : 0xC7) }, 0, dst, size);
+		Immediate(imm, size);
+	}
+
+	void Arith(Alu op, Rm dst, int src, Size size)
+	{
+		Op({ uint8_t(uint8_t(op) * 8 + (size == Size::Byte ? 0 : 1)) }, src, dst, size);
+	}
+
+	void Arith(Alu op, int dst, Rm src, Size size)
+	{
+		Op({ uint8_t(uint8_t(op) * 8 + (size == Size::Byte ? 2 : 3)) }, dst, src, size);
+	}
+
+	void ArithImm(Alu op, Rm dst, uint32_t imm, Size size)
+	{
+		Op({ uint8_t(size == Size::Byte ? 0x80 : 0x81) }, int(op), dst, size);
+		Immediate(imm, size);
+	}
+
+	void ShiftImm(Shift op, Rm dst, uint8_t count, Size size)
+	{
+		Op({ uint8_t(size == Size::Byte ? 0xC0 : 0xC1) }, int(op), dst, size);
+		Byte(count);
+	}
+
+	void Not(Rm dst, Size size) { Op({ uint8_t(size == Size::Byte ? 0xF6 : 0xF7) }, 2, dst, size); }
+	void Test(Rm dst, int src, Size size) { Op({ uint8_t(size == Size::Byte ? 0x84 : 0x85) }, src, dst, size); }
+	void Set(Condition condition, int dst) { Op({ 0x0F, uint8_t(0x90 + uint8_t(condition)) }, 0, Reg(dst), Size::Byte); }
+
+	// mov dst, [base + index * 8]
+	void LoadPage(int dst, int base, int index)
+	{
+		assert(dst < 8 && index < 8 && (base & 7) != RBP && base < 8);
+		Byte(0x48);
+		Byte(0x8B);
+		Byte(0x04 | dst << 3);
+		Byte(0xC0 | index << 3 | base);
+	}
+
+	// movzx dst, byte [base + index]
+	void LoadByte(int dst, int base, int index)
+	{
+		assert(dst < 8 && index < 8 && (base & 7) != RBP && base < 8);
+		Byte(0x0F);
+		Byte(0xB6);
+		Byte(0x04 | dst << 3);
+		Byte(index << 3 | base);
+	}
+
+	// mov [base + index], src8
+	void StoreByte(int base, int index, int src)
+	{
+		assert(src < 4 && index < 8 && (base & 7) != RBP && base < 8);
+		Byte(0x88);
+		Byte(0x04 | src << 3);
+		Byte(index << 3 | base);
+	}
+
+	void Jump(Label label) { Byte(0xE9); Fixup(label); }
+	void Jump(Condition condition, Label label) { Byte(0x0F); Byte(0x80 + uint8_t(condition)); Fixup(label); }
+
+	void Call(const void *function)
+	{
+		MovImm64(RAX, reinterpret_cast<uint64_t>(function));
+		Byte(0xFF);
+		Byte(0xD0);
+	}
+
+	void Push(int reg) { if (reg >= 8) Byte(0x41); Byte(0x50 + (reg & 7)); }
+	void Pop(int reg) { if (reg >= 8) Byte(0x41); Byte(0x58 + (reg & 7)); }
+	void Ret() { Byte(0xC3); }
+
+private:
+	void Raw(const void *data, size_t size)
+	{
+		const uint8_t *bytes = static_cast<const uint8_t*>(data);
+		code_.insert(code_.end(), bytes, bytes + size);
+	}
+
+	void Immediate(uint32_t imm, Size size)
+	{
+		if (size == Size::Byte) Byte(uint8_t(imm));
+		else if (size == Size::Word) Word(uint16_t(imm));
+		else Dword(imm);
+	}
+
+	void Fixup(Label label)
+	{
+		fixups_.emplace_back(code_.size(), label);
+		Dword(0);
+	}
+
+	std::vector<uint8_t> code_;
+	std::vector<int64_t> labels_;
+	std::vector<std::pair<size_t, Label>> fixups_;
+};
+
+// Where the translated code finds things. regRegisters points to the
+// registers, the flags are addressed relative to them as well.
+struct Layout
+{
+	const void *registers;
+	int32_t a, bc, de, hl, sp, pc;
+	int32_t z, n, hx, hy, c;
+	int32_t synced, exit; // relative to regContext
+	const uint8_t * const *readPages;
+	uint8_t * const *writePages;
+	const void *readHelper;
+	const void *writeHelper;
+	const void *interpretHelper;
+};
+
+uint32_t GetTicks(const CachedInstruction &instruction)
+{
+	if (instruction.opcode == 0xCB) return opcodeInfoCB[instruction.operand & 0xFF].ticks;
+	if (instruction.opcode == 0x10) return opcodeInfo10[instruction.operand & 0xFF].ticks;
+	return opcodeInfo[instruction.opcode].ticks;
+}
+
+// Left to the interpreter: rare, or touching state beyond the registers.
+bool IsInterpreted(uint8_t opcode)
+{
+	switch (opcode)
+	{
+	case 0x08: case 0x10: case 0x27: case 0x76:
+	case 0xD9: case 0xE8: case 0xF1: case 0xF3:
+	case 0xF5: case 0xF8: case 0xFB:
+		return true;
+	case 0xCB:
+		return false;
+	default:
+		return opcodeInfo[opcode].name == nullptr;
+	}
+}
+
+// Translates one block. Each instruction is emitted with the ticks of
+// the instructions before it, which is when it runs.
+class BlockTranslator
+{
+public:
+	BlockTranslator(const Layout &layout)
+		:layout_(layout),
+		epilogue_(0),
+		ticks_(0),
+		helperCalled_(false)
+	{
+	}
+
+	std::vector<uint8_t> &Translate(const CodeBlock &block, uint32_t &lastStart)
+	{
+		for (int reg : { RBX, RBP, R12, R13, R14, R15 }) a_.Push(reg);
+		a_.ArithImm(Alu::Sub, Reg(RSP), 8, Size::Qword);
+
+		a_.Mov(Reg(regContext), RDI, Size::Qword);
+		a_.MovImm64(regRegisters, reinterpret_cast<uint64_t>(layout_.registers));
+		LoadRegisters();
+
+		epilogue_ = a_.NewLabel();
+
+		// Exits after an instruction and when it started.
+		std::vector<std::tuple<Assembler::Label, const CachedInstruction*, uint32_t>> exits;
+
+		for (unsigned i = 0; i < block.count; i++)
+		{
+			const CachedInstruction &instruction = block.instructions[i];
+
+			helperCalled_ = false;
+			lastStart = ticks_;
+
+			const bool jumped = Instruction(instruction);
+
+			if (i + 1 == block.count)
+			{
+				Return(instruction, jumped);
+				break;
+			}
+
+			// A helper may have asked to leave.
+			if (helperCalled_)
+			{
+				const Assembler::Label exit = a_.NewLabel();
+				a_.ArithImm(Alu::Cmp, Mem(regContext, layout_.exit), 0, Size::Byte);
+				a_.Jump(Condition::NotEqual, exit);
+				exits.emplace_back(exit, &instruction, ticks_);
+			}
+
+			ticks_ += GetTicks(instruction);
+		}
+
+		for (const auto &[exit, instruction, start] : exits)
+		{
+			a_.Bind(exit);
+			ticks_ = start;
+			Return(*instruction, false);
+		}
+
+		a_.Bind(epilogue_);
+		StoreRegisters();
+		a_.ArithImm(Alu::Add, Reg(RSP), 8, Size::Qword);
+		for (int reg : { R15, R14, R13, R12, RBP, RBX }) a_.Pop(reg);
+		a_.Ret();
+
+		a_.Link();
+		return a_.GetCode();
+	}
+
+private:
+	// Leaves after the instruction. Returns what Jit::Run() needs to
+	// finish it as the last one: the ticks before it not synced yet, its
+	// ticks and its pc.
+	void Return(const CachedInstruction &instruction, bool jumped)
+	{
+		if (!jumped)
+			a_.MovImm(Mem(regRegisters, layout_.pc), uint16_t(instruction.pc + instruction.length), Size::Word);
+
+		a_.MovImm(RAX, ticks_);
+		a_.Arith(Alu::Sub, RAX, Mem(regContext, layout_.synced), Size::Dword);
+		a_.MovImm64(RDX, uint64_t(GetTicks(instruction)) << 16 | uint64_t(instruction.pc) << 32);
+		a_.Arith(Alu::Or, Reg(RAX), RDX, Size::Qword);
+		a_.Jump(epilogue_);
+	}
+
+	void LoadRegisters()
+	{
+		a_.Movzx16(regBC, Mem(regRegisters, layout_.bc));
+		a_.Movzx16(regDE, Mem(regRegisters, layout_.de));
+		a_.Movzx16(regHL, Mem(regRegisters, layout_.hl));
+		a_.Movzx8(regA, Mem(regRegisters, layout_.a));
+	}
+
+	void StoreRegisters()
+	{
+		a_.Mov(Mem(regRegisters, layout_.bc), regBC, Size::Word);
+		a_.Mov(Mem(regRegisters, layout_.de), regDE, Size::Word);
+		a_.Mov(Mem(regRegisters, layout_.hl), regHL, Size::Word);
+		a_.Mov(Mem(regRegisters, layout_.a), regA, Size::Byte);
+	}
+
+	// Zero extended value of an 8-bit register in dst, one of RAX, RCX or
+	// RDX. (HL) is read from memory.
+	void Load8(int dst, Operand operand)
+	{
+		switch (operand)
+		{
+		case Operand::B:
+			// movzx dst, bh
+			a_.Byte(0x0F);
+			a_.Byte(0xB6);
+			a_.Byte(0xC0 | dst << 3 | 7);
+			break;
+		case Operand::C: a_.Movzx8(dst, Reg(regBC)); break;
+		case Operand::D: a_.Mov(Reg(dst), regDE, Size::Dword); a_.ShiftImm(Shift::Shr, Reg(dst), 8, Size::Dword); break;
+		case Operand::E: a_.Movzx8(dst, Reg(regDE)); break;
+		case Operand::H: a_.Mov(Reg(dst), regHL, Size::Dword); a_.ShiftImm(Shift::Shr, Reg(dst), 8, Size::Dword); break;
+		case Operand::L: a_.Movzx8(dst, Reg(regHL)); break;
+		case Operand::A: a_.Mov(Reg(dst), regA, Size::Dword); break;
+		case Operand::IndirectHL:
+			a_.Mov(Reg(RCX), regHL, Size::Dword);
+			Read();
+			if (dst != RAX) a_.Mov(Reg(dst), RAX, Size::Dword);
+			break;
+		}
+	}
+
+	// Stores the low byte of src, one of RAX, RCX or RDX, which may be
+	// clobbered. (HL) is written to memory.
+	void Store8(Operand operand, int src)
+	{
+		switch (operand)
+		{
+		case Operand::B:
+			// mov bh, src
+			a_.Byte(0x88);
+			a_.Byte(0xC0 | src << 3 | 7);
+			break;
+		case Operand::C: a_.Mov(Reg(regBC), src, Size::Byte); break;
+		case Operand::D: StoreHigh(regDE, src); break;
+		case Operand::E: a_.Mov(Reg(regDE), src, Size::Byte); break;
+		case Operand::H: StoreHigh(regHL, src); break;
+		case Operand::L: a_.Mov(Reg(regHL), src, Size::Byte); break;
+		case Operand::A: a_.Movzx8(regA, Reg(src)); break;
+		case Operand::IndirectHL:
+			if (src != RAX) a_.Mov(Reg(RAX), src, Size::Dword);
+			a_.Mov(Reg(RCX), regHL, Size::Dword);
+			Write();
+			break;
+		}
+	}
+
+	void StoreHigh(int pair, int src)
+	{
+		a_.Movzx8(src, Reg(src));
+		a_.ShiftImm(Shift::Shl, Reg(src), 8, Size::Dword);
+		a_.ArithImm(Alu::And, Reg(pair), 0xFF, Size::Dword);
+		a_.Arith(Alu::Or, Reg(pair), src, Size::Dword);
+	}
+
+	// 16-bit register pair of the 0x01 / 0x03 / 0x09 / 0x0B column, SP in
+	// memory.
+	static int Pair(uint8_t opcode)
+	{
+		constexpr int pairs[] = { regBC, regDE, regHL, -1 };
+		return pairs[opcode >> 4];
+	}
+
+	void LoadPair(int dst, uint8_t opcode)
+	{
+		const int pair = Pair(opcode);
+		if (pair < 0) a_.Movzx16(dst, Mem(regRegisters, layout_.sp));
+		else a_.Mov(Reg(dst), pair, Size::Dword);
+	}
+
+	void Flag(int32_t flag, int src) { a_.Mov(Mem(regRegisters, flag), src, Size::Byte); }
+	void FlagImm(int32_t flag, uint8_t value) { a_.MovImm(Mem(regRegisters, flag), value, Size::Byte); }
+
+	// Byte at the address in ECX into EAX. Clobbers RCX, RDX and RSI.
+	void Read()
+	{
+		const Assembler::Label slow = a_.NewLabel();
+		const Assembler::Label done = a_.NewLabel();
+
+		a_.Mov(Reg(RDX), RCX, Size::Dword);
+		a_.ShiftImm(Shift::Shr, Reg(RDX), 8, Size::Dword);
+		a_.MovImm64(RSI, reinterpret_cast<uint64_t>(layout_.readPages));
+		a_.LoadPage(RAX, RSI, RDX);
+		a_.Test(Reg(RAX), RAX, Size::Qword);
+		a_.Jump(Condition::Equal, slow);
+		a_.Movzx8(RCX, Reg(RCX));
+		a_.LoadByte(RAX, RAX, RCX);
+		a_.Jump(done);
+
+		a_.Bind(slow);
+		a_.Mov(Reg(RDI), regContext, Size::Qword);
+		a_.Mov(Reg(RSI), RCX, Size::Dword);
+		a_.MovImm(RDX, ticks_);
+		a_.Call(layout_.readHelper);
+		helperCalled_ = true;
+
+		a_.Bind(done);
+	}
+
+	// Writes the byte in EAX to the address in ECX. Clobbers RAX, RCX,
+	// RDX and RSI.
+	void Write()
+	{
+		const Assembler::Label slow = a_.NewLabel();
+		const Assembler::Label done = a_.NewLabel();
+
+		a_.Mov(Reg(RDX), RCX, Size::Dword);
+		a_.ShiftImm(Shift::Shr, Reg(RDX), 8, Size::Dword);
+		a_.MovImm64(RSI, reinterpret_cast<uint64_t>(layout_.writePages));
+		a_.LoadPage(RSI, RSI, RDX);
+		a_.Test(Reg(RSI), RSI, Size::Qword);
+		a_.Jump(Condition::Equal, slow);
+		a_.Movzx8(RCX, Reg(RCX));
+		a_.StoreByte(RSI, RCX, RAX);
+		a_.Jump(done);
+
+		a_.Bind(slow);
+		a_.Mov(Reg(RDI), regContext, Size::Qword);
+		a_.Mov(Reg(RSI), RCX, Size::Dword);
+		a_.Movzx8(RDX, Reg(RAX));
+		a_.MovImm(RCX, ticks_);
+		a_.Call(layout_.writeHelper);
+		helperCalled_ = true;
+
+		a_.Bind(done);
+	}
+
+	// SP -= 2, then the low byte of value to (SP) and the high byte to
+	// (SP + 1). value is a pinned pair or an immediate if negative.
+	void Push(int pair, uint16_t immediate)
+	{
+		a_.ArithImm(Alu::Sub, Mem(regRegisters, layout_.sp), 2, Size::Word);
+
+		for (int i = 0; i < 2; i++)
+		{
+			if (pair < 0) a_.MovImm(RAX, i ? immediate >> 8 : immediate & 0xFF);
+			else if (i) { a_.Mov(Reg(RAX), pair, Size::Dword); a_.ShiftImm(Shift::Shr, Reg(RAX), 8, Size::Dword); }
+			else a_.Movzx8(RAX, Reg(pair));
+
+			a_.Movzx16(RCX, Mem(regRegisters, layout_.sp));
+			if (i) { a_.ArithImm(Alu::Add, Reg(RCX), 1, Size::Dword); a_.Movzx16(RCX, Reg(RCX)); }
+			Write();
+		}
+	}
+
+	// (SP) to the low byte of dst, (SP + 1) to its high byte, SP += 2.
+	// dst is a memory word relative to regRegisters or a pinned pair.
+	void Pop(int pair, int32_t word)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			a_.Movzx16(RCX, Mem(regRegisters, layout_.sp));
+			if (i) { a_.ArithImm(Alu::Add, Reg(RCX), 1, Size::Dword); a_.Movzx16(RCX, Reg(RCX)); }
+			Read();
+
+			if (pair < 0) a_.Mov(Mem(regRegisters, word + i), RAX, Size::Byte);
+			else if (i) StoreHigh(pair, RAX);
+			else a_.Mov(Reg(pair), RAX, Size::Byte);
+		}
+
+		a_.ArithImm(Alu::Add, Mem(regRegisters, layout_.sp), 2, Size::Word);
+	}
+
+	// Compares the flag a conditional jump, call or return depends on
+	// with 0, see GetCondition().
+	void TestCondition(uint8_t opcode)
+	{
+		const bool carry = opcode & 0x10;
+		a_.ArithImm(Alu::Cmp, Mem(regRegisters, carry ? layout_.c : layout_.z), 0, Size::Byte);
+	}
+
+	// NZ and C hold with a non-zero field, Z and NC with a zero one.
+	Condition GetCondition(uint8_t opcode)
+	{
+		const bool set = opcode & 0x08;
+		const bool carry = opcode & 0x10;
+		return set != carry ? Condition::Equal : Condition::NotEqual;
+	}
+
+	// Value in ECX, A in regA. Clobbers RAX and RDX.
+	void Arithmetic(Operation operation)
+	{
+		switch (operation)
+		{
+		case Operation::Add:
+			a_.Mov(Reg(RDX), regA, Size::Dword);
+			a_.Arith(Alu::Add, Reg(regA), RCX, Size::Byte);
+			a_.Set(Condition::Below, RAX);
+			Flag(layout_.c, RAX);
+			Flag(layout_.z, regA);
+			FlagImm(layout_.n, uint8_t(0));
+			Flag(layout_.hx, regA);
+			Flag(layout_.hy, RDX);
+			break;
+
+		case Operation::Adc:
+			a_.Mov(Reg(RDX), regA, Size::Dword);
+			a_.Arith(Alu::Add, RCX, Mem(regRegisters, layout_.c), Size::Byte);
+			a_.Arith(Alu::Add, Reg(regA), RCX, Size::Byte);
+			a_.Arith(Alu::Cmp, Reg(regA), RDX, Size::Byte);
+			a_.Set(Condition::Below, RAX);
+			Flag(layout_.c, RAX);
+			Flag(layout_.z, regA);
+			FlagImm(layout_.n, uint8_t(0));
+			Flag(layout_.hx, regA);
+			Flag(layout_.hy, RDX);
+			break;
+
+		case Operation::Sub:
+			a_.Mov(Reg(RDX), regA, Size::Dword);
+			a_.Arith(Alu::Sub, Reg(regA), RCX, Size::Byte);
+			a_.Set(Condition::Below, RAX);
+			Flag(layout_.c, RAX);
+			Flag(layout_.z, regA);
+			FlagImm(layout_.n, uint8_t(1));
+			Flag(layout_.hx, RDX);
+			Flag(layout_.hy, RCX);
+			break;
+
+		case Operation::Sbc:
+			// The carry compares against n + c before it wraps.
+			a_.Movzx8(RAX, Mem(regRegisters, layout_.c));
+			a_.Arith(Alu::Add, Reg(RCX), RAX, Size::Dword);
+			a_.Mov(Reg(RDX), regA, Size::Dword);
+			a_.Arith(Alu::Sub, Reg(regA), RCX, Size::Byte);
+			a_.Arith(Alu::Cmp, Reg(RDX), RCX, Size::Dword);
+			a_.Set(Condition::Below, RAX);
+			Flag(layout_.c, RAX);
+			Flag(layout_.z, regA);
+			FlagImm(layout_.n, uint8_t(1));
+			Flag(layout_.hx, RDX);
+			Flag(layout_.hy, RCX);
+			break;
+
+		case Operation::And:
+		case Operation::Xor:
+		case Operation::Or:
+			a_.Arith(operation == Operation::And ? Alu::And : operation == Operation::Xor ? Alu::Xor : Alu::Or,
+				Reg(regA), RCX, Size::Byte);
+			Flag(layout_.z, regA);
+			FlagImm(layout_.n, uint8_t(0));
+			FlagImm(layout_.hx, uint8_t(0));
+			FlagImm(layout_.hy, uint8_t(operation == Operation::And));
+			FlagImm(layout_.c, uint8_t(0));
+			break;
+
+		case Operation::Cp:
+			a_.Mov(Reg(RDX), regA, Size::Dword);
+			a_.Arith(Alu::Sub, Reg(RDX), RCX, Size::Byte);
+			a_.Set(Condition::Below, RAX);
+			Flag(layout_.c, RAX);
+			Flag(layout_.z, RDX);
+			FlagImm(layout_.n, uint8_t(1));
+			Flag(layout_.hx, regA);
+			Flag(layout_.hy, RCX);
+			break;
+
+		default:
+			assert(0);
+		}
+	}
+
+	// Rotates, shifts and SWAP of the CB block on the value in ECX,
+	// result in ECX. Clobbers RAX and RDX.
+	void Rotate(Operation operation)
+	{
+		switch (operation)
+		{
+		case Operation::Rlc:
+		case Operation::Sla:
+		case Operation::Rl:
+			// RLC shifts in 0 like SLA, as the interpreter does.
+			a_.Mov(Reg(RAX), RCX, Size::Dword);
+			a_.ShiftImm(Shift::Shr, Reg(RAX), 7, Size::Dword);
+			a_.ShiftImm(Shift::Shl, Reg(RCX), 1, Size::Dword);
+			if (operation == Operation::Rl) a_.Arith(Alu::Or, RCX, Mem(regRegisters, layout_.c), Size::Byte);
+			break;
+
+		case Operation::Rrc:
+		case Operation::Srl:
+		case Operation::Rr:
+		case Operation::Sra:
+			// And RRC shifts in 0 like SRL.
+			a_.Mov(Reg(RAX), RCX, Size::Dword);
+			a_.ArithImm(Alu::And, Reg(RAX), 1, Size::Dword);
+			if (operation == Operation::Rr)
+			{
+				a_.Movzx8(RDX, Mem(regRegisters, layout_.c));
+				a_.ShiftImm(Shift::Shl, Reg(RDX), 7, Size::Dword);
+			}
+			else if (operation == Operation::Sra)
+			{
+				a_.Mov(Reg(RDX), RCX, Size::Dword);
+				a_.ArithImm(Alu::And, Reg(RDX), 0x80, Size::Dword);
+			}
+			a_.ShiftImm(Shift::Shr, Reg(RCX), 1, Size::Dword);
+			if (operation == Operation::Rr || operation == Operation::Sra)
+				a_.Arith(Alu::Or, Reg(RCX), RDX, Size::Dword);
+			break;
+
+		case Operation::Swap:
+			a_.ShiftImm(Shift::Rol, Reg(RCX), 4, Size::Byte);
+			a_.MovImm(RAX, 0);
+			break;
+
+		default:
+			assert(0);
+		}
+
+		a_.Movzx8(RCX, Reg(RCX));
+		Flag(layout_.z, RCX);
+		FlagImm(layout_.n, uint8_t(0));
+		FlagImm(layout_.hx, uint8_t(0));
+		FlagImm(layout_.hy, uint8_t(0));
+		Flag(layout_.c, RAX);
+	}
+
+	void InstructionCB(uint8_t opcode)
+	{
+		const InstructionSpec spec = instructionSpecsCB[opcode];
+
+		Load8(RCX, spec.target);
+
+		switch (spec.operation)
+		{
+		case Operation::Bit:
+			a_.ArithImm(Alu::And, Reg(RCX), 1 << spec.bit, Size::Dword);
+			Flag(layout_.z, RCX);
+			FlagImm(layout_.n, uint8_t(0));
+			FlagImm(layout_.hx, uint8_t(0));
+			FlagImm(layout_.hy, uint8_t(1));
+			return;
+
+		case Operation::Res:
+			a_.ArithImm(Alu::And, Reg(RCX), ~(1u << spec.bit) & 0xFF, Size::Dword);
+			break;
+
+		case Operation::Set:
+			a_.ArithImm(Alu::Or, Reg(RCX), 1 << spec.bit, Size::Dword);
+			break;
+
+		default:
+			Rotate(spec.operation);
+			break;
+		}
+
+		Store8(spec.target, RCX);
+	}
+
+	// Translates a single instruction. Returns whether it set the pc.
+	bool Instruction(const CachedInstruction &instruction)
+	{
+		const uint8_t opcode = instruction.opcode;
+		const uint8_t n8 = instruction.operand & 0xFF;
+		const uint16_t n16 = instruction.operand;
+		const uint16_t next = instruction.pc + instruction.length;
+
+		if (IsInterpreted(opcode))
+		{
+			Interpret(instruction);
+			return opcode == 0x10 || opcode == 0x76 || opcode == 0xD9 || !opcodeInfo[opcode].name;
+		}
+
+		if (opcode >= 0x40 && opcode < 0xC0)
+		{
+			const InstructionSpec spec = instructionSpecs[opcode];
+			Load8(RCX, spec.source);
+			if (spec.operation == Operation::Ld) Store8(spec.target, RCX);
+			else Arithmetic(spec.operation);
+			return false;
+		}
+
+		// Register of the 0x04 / 0x05 / 0x06 columns.
+		const Operand operand = Operand((opcode >> 3) & 7);
+
+		switch (opcode)
+		{
+		case 0x00:
+			return false;
+
+		case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x36: case 0x3E:
+			a_.MovImm(RCX, n8);
+			Store8(operand, RCX);
+			return false;
+
+		case 0x04: case 0x0C: case 0x14: case 0x1C: case 0x24: case 0x2C: case 0x34: case 0x3C:
+			Load8(RCX, operand);
+			a_.Mov(Reg(RDX), RCX, Size::Dword);
+			a_.ArithImm(Alu::Add, Reg(RCX), 1, Size::Byte);
+			Flag(layout_.z, RCX);
+			FlagImm(layout_.n, uint8_t(0));
+			Flag(layout_.hx, RCX);
+			Flag(layout_.hy, RDX);
+			Store8(operand, RCX);
+			return false;
+
+		case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D: case 0x35: case 0x3D:
+			Load8(RCX, operand);
+			a_.Mov(Reg(RDX), RCX, Size::Dword);
+			a_.ArithImm(Alu::Sub, Reg(RCX), 1, Size::Byte);
+			Flag(layout_.z, RCX);
+			FlagImm(layout_.n, uint8_t(1));
+			Flag(layout_.hx, RDX);
+			FlagImm(layout_.hy, uint8_t(1));
+			Store8(operand, RCX);
+			return false;
+
+		case 0x0A: case 0x1A:
+			a_.Mov(Reg(RCX), opcode == 0x0A ? regBC : regDE, Size::Dword);
+			Read();
+			a_.Mov(Reg(regA), RAX, Size::Dword);
+			return false;
+
+		case 0xFA:
+			a_.MovImm(RCX, n16);
+			Read();
+			a_.Mov(Reg(regA), RAX, Size::Dword);
+			return false;
+
+		case 0xF0:
+			a_.MovImm(RCX, 0xFF00 + n8);
+			Read();
+			a_.Mov(Reg(regA), RAX, Size::Dword);
+			return false;
+
+		case 0xF2:
+			a_.Movzx8(RCX, Reg(regBC));
+			a_.ArithImm(Alu::Or, Reg(RCX), 0xFF00, Size::Dword);
+			Read();
+			a_.Mov(Reg(regA), RAX, Size::Dword);
+			return false;
+
+		case 0x02: case 0x12:
+			a_.Mov(Reg(RCX), opcode == 0x02 ? regBC : regDE, Size::Dword);
+			a_.Mov(Reg(RAX), regA, Size::Dword);
+			Write();
+			return false;
+
+		case 0xEA:
+			a_.MovImm(RCX, n16);
+			a_.Mov(Reg(RAX), regA, Size::Dword);
+			Write();
+			return false;
+
+		case 0xE0:
+			a_.MovImm(RCX, 0xFF00 + n8);
+			a_.Mov(Reg(RAX), regA, Size::Dword);
+			Write();
+			return false;
+
+		case 0xE2:
+			a_.Movzx8(RCX, Reg(regBC));
+			a_.ArithImm(Alu::Or, Reg(RCX), 0xFF00, Size::Dword);
+			a_.Mov(Reg(RAX), regA, Size::Dword);
+			Write();
+			return false;
+
+		case 0x22: case 0x32: case 0x2A: case 0x3A:
+			a_.Mov(Reg(RCX), regHL, Size::Dword);
+			if (opcode & 0x08)
+			{
+				Read();
+				a_.Mov(Reg(regA), RAX, Size::Dword);
+			}
+			else
+			{
+				a_.Mov(Reg(RAX), regA, Size::Dword);
+				Write();
+			}
+			a_.ArithImm(opcode & 0x10 ? Alu::Sub : Alu::Add, Reg(regHL), 1, Size::Dword);
+			a_.Movzx16(regHL, Reg(regHL));
+			return false;
+
+		case 0x01: case 0x11: case 0x21:
+			a_.MovImm(Pair(opcode), n16);
+			return false;
+
+		case 0x31:
+			a_.MovImm(Mem(regRegisters, layout_.sp), n16, Size::Word);
+			return false;
+
+		case 0xF9:
+			a_.Mov(Mem(regRegisters, layout_.sp), regHL, Size::Word);
+			return false;
+
+		case 0x03: case 0x13: case 0x23: case 0x0B: case 0x1B: case 0x2B:
+			a_.ArithImm(opcode & 0x08 ? Alu::Sub : Alu::Add, Reg(Pair(opcode)), 1, Size::Dword);
+			a_.Movzx16(Pair(opcode), Reg(Pair(opcode)));
+			return false;
+
+		case 0x33: case 0x3B:
+			a_.ArithImm(opcode & 0x08 ? Alu::Sub : Alu::Add, Mem(regRegisters, layout_.sp), 1, Size::Word);
+			return false;
+
+		case 0x09: case 0x19: case 0x29: case 0x39:
+			// H is the carry out of bit 11.
+			LoadPair(RCX, opcode);
+			a_.Mov(Reg(RAX), regHL, Size::Dword);
+			a_.Arith(Alu::Add, Reg(regHL), RCX, Size::Dword);
+			a_.Movzx16(regHL, Reg(regHL));
+			a_.Arith(Alu::Cmp, Reg(regHL), RAX, Size::Dword);
+			a_.Set(Condition::Below, RCX);
+			Flag(layout_.c, RCX);
+			a_.Mov(Reg(RDX), regHL, Size::Dword);
+			a_.ArithImm(Alu::And, Reg(RDX), 0xFFF, Size::Dword);
+			a_.ArithImm(Alu::And, Reg(RAX), 0xFFF, Size::Dword);
+			a_.Arith(Alu::Cmp, Reg(RDX), RAX, Size::Dword);
+			a_.Set(Condition::Below, RDX);
+			FlagImm(layout_.n, uint8_t(0));
+			FlagImm(layout_.hx, uint8_t(0));
+			Flag(layout_.hy, RDX);
+			return false;
+
+		case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+			a_.MovImm(RCX, n8);
+			Arithmetic(instructionSpecs[0x80 | (opcode & 0x38)].operation);
+			return false;
+
+		case 0x2F:
+			a_.Not(Reg(regA), Size::Byte);
+			FlagImm(layout_.n, uint8_t(1));
+			FlagImm(layout_.hx, uint8_t(0));
+			FlagImm(layout_.hy, uint8_t(1));
+			return false;
+
+		case 0x37: case 0x3F:
+			FlagImm(layout_.n, uint8_t(0));
+			FlagImm(layout_.hx, uint8_t(0));
+			FlagImm(layout_.hy, uint8_t(0));
+			if (opcode == 0x37) FlagImm(layout_.c, uint8_t(1));
+			else a_.ArithImm(Alu::Xor, Mem(regRegisters, layout_.c), 1, Size::Byte);
+			return false;
+
+		// RLCA, RRCA, RLA and RRA work like their CB forms, Z included.
+		case 0x07: case 0x0F: case 0x17: case 0x1F:
+			a_.Mov(Reg(RCX), regA, Size::Dword);
+			Rotate(instructionSpecsCB[opcode].operation);
+			a_.Mov(Reg(regA), RCX, Size::Dword);
+			return false;
+
+		case 0xCB:
+			InstructionCB(n8);
+			return false;
+
+		case 0xC5: case 0xD5: case 0xE5:
+			Push(Pair(opcode - 0xC0), 0);
+			return false;
+
+		case 0xC1: case 0xD1: case 0xE1:
+			Pop(Pair(opcode - 0xC0), 0);
+			return false;
+
+		case 0xC3:
+			a_.MovImm(Mem(regRegisters, layout_.pc), n16, Size::Word);
+			return true;
+
+		case 0xE9:
+			a_.Mov(Mem(regRegisters, layout_.pc), regHL, Size::Word);
+			return true;
+
+		case 0x18:
+			a_.MovImm(Mem(regRegisters, layout_.pc), uint16_t(next + int8_t(n8)), Size::Word);
+			return true;
+
+		case 0xC2: case 0xCA: case 0xD2: case 0xDA:
+		case 0x20: case 0x28: case 0x30: case 0x38:
+		{
+			const uint16_t target = opcode < 0x40 ? uint16_t(next + int8_t(n8)) : n16;
+			const Assembler::Label taken = a_.NewLabel();
+			const Assembler::Label done = a_.NewLabel();
+
+			TestCondition(opcode);
+			a_.Jump(GetCondition(opcode), taken);
+			a_.MovImm(Mem(regRegisters, layout_.pc), next, Size::Word);
+			a_.Jump(done);
+			a_.Bind(taken);
+			a_.MovImm(Mem(regRegisters, layout_.pc), target, Size::Word);
+			a_.Bind(done);
+			return true;
+		}
+
+		case 0xCD:
+			Push(-1, next);
+			a_.MovImm(Mem(regRegisters, layout_.pc), n16, Size::Word);
+			return true;
+
+		case 0xC4: case 0xCC: case 0xD4: case 0xDC:
+		{
+			const Assembler::Label taken = a_.NewLabel();
+			const Assembler::Label done = a_.NewLabel();
+
+			TestCondition(opcode);
+			a_.Jump(GetCondition(opcode), taken);
+			a_.MovImm(Mem(regRegisters, layout_.pc), next, Size::Word);
+			a_.Jump(done);
+			a_.Bind(taken);
+			Push(-1, next);
+			a_.MovImm(Mem(regRegisters, layout_.pc), n16, Size::Word);
+			a_.Bind(done);
+			return true;
+		}
+
+		case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+			Push(-1, next);
+			a_.MovImm(Mem(regRegisters, layout_.pc), opcode & 0x38, Size::Word);
+			return true;
+
+		case 0xC9:
+			Pop(-1, layout_.pc);
+			return true;
+
+		case 0xC0: case 0xC8: case 0xD0: case 0xD8:
+		{
+			const Assembler::Label taken = a_.NewLabel();
+			const Assembler::Label done = a_.NewLabel();
+
+			TestCondition(opcode);
+			a_.Jump(GetCondition(opcode), taken);
+			a_.MovImm(Mem(regRegisters, layout_.pc), next, Size::Word);
+			a_.Jump(done);
+			a_.Bind(taken);
+			Pop(-1, layout_.pc);
+			a_.Bind(done);
+			return true;
+		}
+
+		default:
+			assert(0);
+			return false;
+		}
+	}
+
+	// Hands the instruction to the interpreter, with the registers in
+	// memory where it expects them.
+	void Interpret(const CachedInstruction &instruction)
+	{
+		StoreRegisters();
+		a_.MovImm(Mem(regRegisters, layout_.pc), instruction.pc, Size::Word);
+
+		a_.Mov(Reg(RDI), regContext, Size::Qword);
+		a_.MovImm64(RSI, uint64_t(instruction.pc) | uint64_t(instruction.operand) << 16 |
+			uint64_t(instruction.opcode) << 32 | uint64_t(instruction.length) << 40);
+		a_.MovImm(RDX, ticks_);
+		a_.Call(layout_.interpretHelper);
+		helperCalled_ = true;
+
+		LoadRegisters();
+	}
+
+	Assembler a_;
+	const Layout &layout_;
+
+	Assembler::Label epilogue_;
+	uint32_t ticks_; // of the instructions before the current one
+	bool helperCalled_;
+};
+
+int32_t GetOffset(const void *base, const void *field)
+{
+	return int32_t(static_cast<const uint8_t*>(field) - static_cast<const uint8_t*>(base));
+}
+
+}
+
+Jit::Jit(Memory &memory, Pic &pic, Scheduler &scheduler, BlockCache &blockCache,
+	Registers &regs, LazyFlags &flags, const bool &interruptsEnabled,
+	const bool &halted, Interpreter interpreter)
+	:memory_(memory),
+	pic_(pic),
+	scheduler_(scheduler),
+	blockCache_(blockCache),
+	regs_(regs),
+	flags_(flags),
+	interruptsEnabled_(interruptsEnabled),
+	halted_(halted),
+	interpreter_(interpreter),
+	arena_(nullptr),
+	arenaUsed_(0),
+	context_({ this, 0, 0 }),
+	deadline_(0),
+	generation_(0)
+{
+	int mapFlags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_JIT
+	mapFlags |= MAP_JIT;
+#endif
+
+	// Without an arena everything is interpreted.
+	void *arena = mmap(nullptr, arenaSize_, PROT_READ | PROT_WRITE | PROT_EXEC, mapFlags, -1, 0);
+	if (arena != MAP_FAILED)
+		arena_ = static_cast<uint8_t*>(arena);
+}
+
+Jit::~Jit()
+{
+	if (arena_)
+		munmap(arena_, arenaSize_);
+}
+
+bool Jit::Run(const CodeBlock &block, uint64_t limit, uint32_t &ticks, uint16_t &pc)
+{
+	if (!arena_)
+		return false;
+
+	if (!block.native)
+		block.native = Translate(block);
+
+	const Translation *translation = static_cast<const Translation*>(block.native);
+	if (!translation)
+		return false;
+
+	// Like ContinueFused(), every instruction but the last has to end
+	// before the deadline.
+	const uint64_t now = scheduler_.GetNow();
+	deadline_ = scheduler_.GetNextDeadline();
+	if (now + translation->lastStart >= std::min(deadline_, limit))
+		return false;
+
+	generation_ = blockCache_.GetGeneration();
+	context_.synced = 0;
+	context_.exit = 0;
+
+	const uint64_t result = translation->code(&context_);
+
+	scheduler_.Advance(uint32_t(result & 0xFFFF));
+	ticks = uint32_t(result >> 16) & 0xFFFF;
+	pc = uint16_t(result >> 32);
+	return true;
+}
+
+const Jit::Translation *Jit::Translate(const CodeBlock &block)
+{
+	const Layout layout = {
+		&regs_,
+		GetOffset(&regs_, &regs_.a),
+		GetOffset(&regs_, &regs_.bc),
+		GetOffset(&regs_, &regs_.de),
+		GetOffset(&regs_, &regs_.hl),
+		GetOffset(&regs_, &regs_.sp),
+		GetOffset(&regs_, &regs_.pc),
+		GetOffset(&regs_, &flags_.z),
+		GetOffset(&regs_, &flags_.n),
+		GetOffset(&regs_, &flags_.hx),
+		GetOffset(&regs_, &flags_.hy),
+		GetOffset(&regs_, &flags_.c),
+		GetOffset(&context_, &context_.synced),
+		GetOffset(&context_, &context_.exit),
+		memory_.GetReadPages(),
+		memory_.GetWritePages(),
+		reinterpret_cast<const void*>(&ReadHelper),
+		reinterpret_cast<const void*>(&WriteHelper),
+		reinterpret_cast<const void*>(&InterpretHelper),
+	};
+
+	uint32_t lastStart = 0;
+	BlockTranslator translator(layout);
+	const std::vector<uint8_t> &code = translator.Translate(block, lastStart);
+
+	// Start over once the arena is full, code comes after its header.
+	const size_t size = (sizeof(Translation) + code.size() + 15) & ~size_t(15);
+	if (size > arenaSize_)
+		return nullptr;
+
+	if (arenaUsed_ + size > arenaSize_)
+	{
+		blockCache_.DropNative();
+		arenaUsed_ = 0;
+	}
+
+	uint8_t *header = arena_ + arenaUsed_;
+	uint8_t *native = header + sizeof(Translation);
+	arenaUsed_ += size;
+
+	std::memcpy(native, code.data(), code.size());
+
+	Translation *translation = reinterpret_cast<Translation*>(header);
+	translation->code = reinterpret_cast<NativeBlock>(native);
+	translation->lastStart = lastStart;
+	return translation;
+}
+
+void Jit::Sync(uint32_t ticks)
+{
+	scheduler_.Advance(ticks - context_.synced);
+	context_.synced = ticks;
+}
+
+void Jit::CheckExit()
+{
+	if (scheduler_.GetNextDeadline() != deadline_ || blockCache_.GetGeneration() != generation_ ||
+		(interruptsEnabled_ && pic_.InterruptRequested()) || halted_)
+		context_.exit = 1;
+}
+
+uint32_t Jit::ReadHelper(Context *context, uint32_t address, uint32_t ticks)
+{
+	Jit &jit = *context->jit;
+	jit.Sync(ticks);
+	const uint8_t data = jit.memory_.Read(uint16_t(address));
+	jit.CheckExit();
+	return data;
+}
+
+void Jit::WriteHelper(Context *context, uint32_t address, uint32_t data, uint32_t ticks)
+{
+	Jit &jit = *context->jit;
+	jit.Sync(ticks);
+	jit.memory_.Write(uint16_t(address), uint8_t(data));
+	jit.CheckExit();
+}
+
+void Jit::InterpretHelper(Context *context, uint64_t instruction, uint32_t ticks)
+{
+	Jit &jit = *context->jit;
+	jit.Sync(ticks);
+
+	CachedInstruction unpacked = {};
+	unpacked.pc = uint16_t(instruction);
+	unpacked.operand = uint16_t(instruction >> 16);
+	unpacked.opcode = uint8_t(instruction >> 32);
+	unpacked.length = uint8_t(instruction >> 40);
+
+	const uint32_t executed = jit.interpreter_(unpacked);
+	assert(executed == GetTicks(unpacked));
+	(void)executed;
+
+	jit.CheckExit();
+}
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "blockcache.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace GBEmu::Emulator
+{
+
+class Memory;
+class Pic;
+class Scheduler;
+struct Registers;
+struct LazyFlags;
+
+// Translates the blocks of the block cache to x86-64 code. B, C, D, E, H,
+// L and A live in host registers while a block runs, the flags stay
+// lazy in LazyFlags. Reads and writes through a page pointer are inlined,
+// everything else calls back into Memory, which first brings the
+// scheduler up to the instruction, so peripherals see the same time as
+// with the interpreter. The few instructions that are not translated
+// (DAA, PUSH/POP AF, the SP arithmetic, DI/EI, HALT, STOP, RETI) call the
+// interpreter.
+//
+// A block only runs natively if its last instruction starts before the
+// next scheduler deadline. It is left early, after the instruction at
+// fault, if a callback changed what that decision was based on: the
+// deadline, the blocks themselves (code writes, bank switches) or a
+// pending interrupt.
+class Jit
+{
+public:
+	// Runs a single instruction at its pc, returns its ticks.
+	using Interpreter = std::function<uint32_t(const CachedInstruction &instruction)>;
+
+	Jit(Memory &memory, Pic &pic, Scheduler &scheduler, BlockCache &blockCache,
+		Registers &regs, LazyFlags &flags, const bool &interruptsEnabled,
+		const bool &halted, Interpreter interpreter);
+	~Jit();
+
+	Jit(const Jit&) = delete;
+	Jit &operator=(const Jit&) = delete;
+
+	// Runs block, which starts at the pc, if it ends before the next
+	// deadline and before limit. Like Cpu::Tick() it returns the ticks of
+	// the last instruction in ticks and its pc in pc, earlier
+	// instructions have advanced the scheduler already.
+	// Returns false and changes nothing if the block has to be
+	// interpreted.
+	bool Run(const CodeBlock &block, uint64_t limit, uint32_t &ticks, uint16_t &pc);
+
+private:
+	// Shared with the translated code, which keeps a pointer to it in r12.
+	struct Context
+	{
+		Jit *jit;
+		uint32_t synced;	// ticks into the block the scheduler is at
+		uint8_t exit;		// leave after the current instruction
+	};
+
+	using NativeBlock = uint64_t (*)(Context *context);
+
+	// Translation of a block, followed by its code.
+	struct Translation
+	{
+		NativeBlock code;
+		uint32_t lastStart; // ticks into the block the last instruction starts at
+	};
+
+	const Translation *Translate(const CodeBlock &block);
+	void Sync(uint32_t ticks);
+	void CheckExit();
+
+	static uint32_t ReadHelper(Context *context, uint32_t address, uint32_t ticks);
+	static void WriteHelper(Context *context, uint32_t address, uint32_t data, uint32_t ticks);
+	static void InterpretHelper(Context *context, uint64_t instruction, uint32_t ticks);
+
+	// Translations are only ever appended. Once it is full, all of them
+	// are dropped and the cache starts over.
+	static constexpr size_t arenaSize_ = 8 << 20;
+
+	Memory &memory_;
+	Pic &pic_;
+	Scheduler &scheduler_;
+	BlockCache &blockCache_;
+	Registers &regs_;
+	LazyFlags &flags_;
+	const bool &interruptsEnabled_;
+	const bool &halted_;
+	Interpreter interpreter_;
+
+	uint8_t *arena_;
+	size_t arenaUsed_;
+
+	Context context_;
+
+	// What the block was entered with.
+	uint64_t deadline_;
+	uint32_t generation_;
+};
+
+}
\ No newline at end of file
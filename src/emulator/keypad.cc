@@ -1,5 +1,6 @@
 #include "keypad.hh"
 #include "io.hh"
+#include "state.hh"
 
 namespace GBEmu::Emulator
 {
@@ -42,4 +43,18 @@ void Keypad::SetKeys(const KeypadKeys &keys)
 		keys_[i] = keys[i];
 }
 
+void Keypad::SaveState(StateWriter &writer) const
+{
+	writer.Write(keys_);
+	writer.Write(buttonKeys_);
+	writer.Write(directionKeys_);
+}
+
+void Keypad::LoadState(StateReader &reader)
+{
+	reader.Read(keys_);
+	reader.Read(buttonKeys_);
+	reader.Read(directionKeys_);
+}
+
 }
\ No newline at end of file
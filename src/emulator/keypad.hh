@@ -6,6 +6,8 @@ namespace GBEmu::Emulator
 {
 
 class IO;
+class StateWriter;
+class StateReader;
 
 using KeypadKeys = std::array<bool, 8>;
 
@@ -16,6 +18,9 @@ public:
 
 	void SetKeys(const KeypadKeys &keys);
 
+	void SaveState(StateWriter &writer) const;
+	void LoadState(StateReader &reader);
+
 	enum Keys
 	{
 		Start = 0,
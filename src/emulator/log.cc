@@ -11,7 +11,9 @@ Log::Log(const std::string &filename)
 	instructionFilter_(0),
 	mask_(0)
 {
-	stream_.open(filename);
+	// No file name, no log (headless runs).
+	if (!filename.empty())
+		stream_.open(filename);
 
 	stream_ << "Start" << std::endl;
 
@@ -7,8 +7,19 @@
 namespace GBEmu::Emulator
 {
 
+void MemoryRegion::RemapPages()
+{
+	if (memory_) memory_->Remap(this);
+}
+
 Memory::Memory(Log &log)
-	:log_(log)
+	:log_(log),
+	readPages_({}),
+	writePages_({}),
+	handlers_({})
+#ifdef GBEMU_BLOCK_CACHE
+	,codeBytes_({})
+#endif
 {
 
 }
@@ -18,64 +29,119 @@ void Memory::Register(MemoryRegion *region, uint16_t base)
 	assert(region);
 	assert(region->GetSize() > 0);
 	assert((uint32_t)base + (uint32_t)region->GetSize() <= 0x10000);
+	assert(!(base & 0xFF)); // Regions must start on a page boundary.
 
-	// TODO check for overlapping regions.
+	for (uint32_t page = base >> 8; page <= uint32_t(base + region->GetSize() - 1) >> 8; page++)
+	{
+		assert(!handlers_[page].region); // Overlapping regions.
+		handlers_[page] = { region, uint16_t((page << 8) - base) };
+	}
 
 	region->SetBase(base);
-	regions_.push_back(region);
+	region->SetMemory(this);
+
+	Remap(region);
 }
 
-uint8_t Memory::Read(uint16_t address)
+void Memory::Remap(MemoryRegion *region)
 {
-	if (address >= 0xFEA0 && address <= 0xFEFF) return 0; // Not usable
+	for (size_t page = 0; page < pageCount_; page++)
+	{
+		if (handlers_[page].region != region) continue;
+
+		readPages_[page] = region->GetReadPage(handlers_[page].offset);
+#ifdef GBEMU_BLOCK_CACHE
+		writePages_[page] = codePages_.test(page) ? nullptr : region->GetWritePage(handlers_[page].offset);
+#else
+		writePages_[page] = region->GetWritePage(handlers_[page].offset);
+#endif
+	}
 
-	if (address >= 0xE000 && address <= 0xFDFF) address -= 0x2000;
+	UpdateEchoPages();
+#ifdef GBEMU_BLOCK_CACHE
+	if (remapHandler_) remapHandler_();
+#endif
+}
 
-	auto *region = LookupRegion(address);
+#ifdef GBEMU_BLOCK_CACHE
+void Memory::MarkCode(uint16_t address, uint8_t length)
+{
+	const uint8_t page = GetPhysicalPage(address >> 8);
+	assert((address & 0xFF) + length <= 0x100); // Instructions are marked within their page.
 
-	if (region)
-	{
-		return region->Read(address - region->GetBase());
-	}
-	else
+	for (uint8_t i = 0; i < length; i++)
+		codeBytes_[page].set((address & 0xFF) + i);
+
+	if (codePages_.test(page)) return;
+
+	codePages_.set(page);
+	writePages_[page] = nullptr;
+	UpdateEchoPages();
+}
+#endif
+
+void Memory::UpdateEchoPages()
+{
+	// E000-FDFF mirrors C000-DDFF.
+	for (size_t page = 0xE0; page <= 0xFD; page++)
 	{
-		log_.Error("Memory read at " + AsHexString(address) + " not implemented");
-		return 0;
+		readPages_[page] = readPages_[page - 0x20];
+		writePages_[page] = writePages_[page - 0x20];
+		handlers_[page] = handlers_[page - 0x20];
 	}
 }
 
-void Memory::Write(uint16_t address, uint8_t data)
+uint8_t Memory::ReadSlow(uint16_t address)
 {
-	if (address >= 0xFEA0 && address <= 0xFEFF) return; // Not usable
+	if (address >= 0xFEA0 && address <= 0xFEFF) return 0; // Not usable
 
-	if (address >= 0xE000 && address <= 0xFDFF) address -= 0x2000;
+	const PageHandler &handler = handlers_[address >> 8];
 
-	auto *region = LookupRegion(address);
-	
-	if (region)
+	if (handler.region)
 	{
-		region->Write(address - region->GetBase(), data);
+		return handler.region->Read(handler.offset + (address & 0xFF));
 	}
 	else
 	{
-		log_.Error("Memory write at " + AsHexString(address) + " (" + AsHexString(data) + ") not implemented");
+		log_.Error("Memory read at " + AsHexString(address) + " not implemented");
+		return 0;
 	}
 }
 
-MemoryRegion *Memory::LookupRegion(uint16_t address)
+void Memory::WriteSlow(uint16_t address, uint8_t data)
 {
-	for (auto region : regions_)
+	if (address >= 0xFEA0 && address <= 0xFEFF) return; // Not usable
+
+#ifdef GBEMU_BLOCK_CACHE
+	// Write to decoded code, drop the code of the page and let the
+	// following writes take the fast path again. Other bytes of the page,
+	// e.g. variables next to a routine, are written as usual.
+	const uint8_t page = GetPhysicalPage(address >> 8);
+	if (codePages_.test(page) && codeBytes_[page].test(address & 0xFF))
 	{
-		auto base = region->GetBase();
-		auto size = region->GetSize();
+		codePages_.reset(page);
+		codeBytes_[page].reset();
+		if (handlers_[page].region)
+			writePages_[page] = handlers_[page].region->GetWritePage(handlers_[page].offset);
+		UpdateEchoPages();
+
+		if (codeWriteHandler_) codeWriteHandler_(page);
 
-		if (address >= base && (uint32_t)address < (uint32_t)base + (uint32_t)size)
-		{
-			return region;
-		}
+		Write(address, data);
+		return;
 	}
+#endif
+
+	const PageHandler &handler = handlers_[address >> 8];
 
-	return nullptr;
+	if (handler.region)
+	{
+		handler.region->Write(handler.offset + (address & 0xFF), data);
+	}
+	else
+	{
+		log_.Error("Memory write at " + AsHexString(address) + " (" + AsHexString(data) + ") not implemented");
+	}
 }
 
 }
\ No newline at end of file
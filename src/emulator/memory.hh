@@ -1,14 +1,18 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
-
-#include <map>
-#include <vector>
+#include <array>
+#ifdef GBEMU_BLOCK_CACHE
+#include <bitset>
+#include <functional>
+#endif
 
 namespace GBEmu::Emulator
 {
 
 class Log;
+class Memory;
 
 class MemoryRegion
 {
@@ -17,11 +21,24 @@ public:
 	virtual uint8_t Read(uint16_t offset) = 0;
 	virtual void Write(uint16_t offset, uint8_t data) = 0;
 
+	// Host memory backing the 256 byte page starting at offset. Regions that
+	// return nullptr are accessed through Read() / Write() instead.
+	virtual uint8_t *GetReadPage(uint16_t offset) { return nullptr; }
+	virtual uint8_t *GetWritePage(uint16_t offset) { return nullptr; }
+
 	void SetBase(uint16_t base) { base_ = base; }
 	uint16_t GetBase() const { return base_; }
 
+	void SetMemory(Memory *memory) { memory_ = memory; }
+
+protected:
+	// Must be called whenever the pointers returned by GetReadPage() /
+	// GetWritePage() change, e.g. after switching banks.
+	void RemapPages();
+
 private:
 	uint16_t base_;
+	Memory *memory_ = nullptr;
 };
 
 class Memory
@@ -30,16 +47,81 @@ public:
 	Memory(Log &log);
 
 	void Register(MemoryRegion *region, uint16_t base);
+	void Remap(MemoryRegion *region);
+
+	uint8_t Read(uint16_t address)
+	{
+		const uint8_t *page = readPages_[address >> 8];
+		if (page) return page[address & 0xFF];
+		return ReadSlow(address);
+	}
+
+	void Write(uint16_t address, uint8_t data)
+	{
+		uint8_t *page = writePages_[address >> 8];
+		if (page) page[address & 0xFF] = data;
+		else WriteSlow(address, data);
+	}
 
-	uint8_t Read(uint16_t address);
-	void Write(uint16_t address, uint8_t data);
+	// Host address of the byte at address, nullptr if its page has no
+	// read page.
+	const uint8_t *GetReadPointer(uint16_t address) const
+	{
+		const uint8_t *page = readPages_[address >> 8];
+		return page ? page + (address & 0xFF) : nullptr;
+	}
+
+#ifdef GBEMU_BLOCK_CACHE
+	// Bytes code was decoded from. Writes to their pages go through
+	// WriteSlow(), a write to one of the bytes unmarks the page and hands
+	// it to the code write handler. Echo RAM is handed in as the page it
+	// mirrors.
+	using CodeWriteHandler = std::function<void(uint8_t page)>;
+	void SetCodeWriteHandler(CodeWriteHandler handler) { codeWriteHandler_ = handler; }
+	void MarkCode(uint16_t address, uint8_t length);
+
+	// Called after pages were remapped, host addresses handed out by
+	// GetReadPointer() may now back other addresses.
+	using RemapHandler = std::function<void()>;
+	void SetRemapHandler(RemapHandler handler) { remapHandler_ = handler; }
+
+	// Page backing page, echo RAM pages map to the page they mirror.
+	static uint8_t GetPhysicalPage(uint8_t page)
+	{
+		return (page >= 0xE0 && page <= 0xFD) ? page - 0x20 : page;
+	}
+#endif
+
+#ifdef GBEMU_JIT
+	// Page tables of Read() and Write(), the jit inlines their fast paths.
+	const uint8_t * const *GetReadPages() const { return readPages_.data(); }
+	uint8_t * const *GetWritePages() const { return writePages_.data(); }
+#endif
 
 private:
-	MemoryRegion * LookupRegion(uint16_t address);
+	struct PageHandler
+	{
+		MemoryRegion *region;
+		uint16_t offset;
+	};
+
+	uint8_t ReadSlow(uint16_t address);
+	void WriteSlow(uint16_t address, uint8_t data);
+	void UpdateEchoPages();
 
 private:
+	static constexpr size_t pageCount_ = 256;
+
 	Log & log_;
-	std::vector<MemoryRegion*> regions_;
+	std::array<const uint8_t*, pageCount_> readPages_;
+	std::array<uint8_t*, pageCount_> writePages_;
+	std::array<PageHandler, pageCount_> handlers_;
+#ifdef GBEMU_BLOCK_CACHE
+	std::bitset<pageCount_> codePages_;
+	std::array<std::bitset<256>, pageCount_> codeBytes_;
+	CodeWriteHandler codeWriteHandler_;
+	RemapHandler remapHandler_;
+#endif
 };
 
 }
\ No newline at end of file
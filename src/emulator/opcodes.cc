@@ -0,0 +1,443 @@
+#include "opcodes.hh"
+#include "instructionspec.hh"
+
+namespace GBEmu::Emulator
+{
+
+namespace
+{
+
+constexpr std::array<Mnemonic, 256> mnemonics = MakeMnemonics(instructionSpecs);
+constexpr std::array<Mnemonic, 256> mnemonicsCB = MakeMnemonics(instructionSpecsCB);
+
+// Opcodes around the regular block 40-BF, which comes from the
+// instruction spec.
+constexpr std::array<OpcodeInfo, 0x40> opcodeInfoLow = {{
+	/* 00 */ { "NOP", 0, 4 },
+	/* 01 */ { "LD BC,nn", 2, 12 },
+	/* 02 */ { "LD (BC),A", 0, 8 },
+	/* 03 */ { "INC BC", 0, 8 },
+	/* 04 */ { "INC B", 0, 4 },
+	/* 05 */ { "DEC B", 0, 4 },
+	/* 06 */ { "LD B,n", 1, 8 },
+	/* 07 */ { "RLCA", 0, 4 },
+	/* 08 */ { "LD (nn),SP", 2, 20 },
+	/* 09 */ { "ADD HL,BC", 0, 8 },
+	/* 0A */ { "LD A,(BC)", 0, 8 },
+	/* 0B */ { "DEC BC", 0, 8 },
+	/* 0C */ { "INC C", 0, 4 },
+	/* 0D */ { "DEC C", 0, 4 },
+	/* 0E */ { "LD C,n", 1, 8 },
+	/* 0F */ { "RRCA", 0, 4 },
+	/* 10 */ { nullptr, 0, 0 },
+	/* 11 */ { "LD DE,nn", 2, 12 },
+	/* 12 */ { "LD (DE),A", 0, 8 },
+	/* 13 */ { "INC DE", 0, 8 },
+	/* 14 */ { "INC D", 0, 4 },
+	/* 15 */ { "DEC D", 0, 4 },
+	/* 16 */ { "LD D,n", 1, 8 },
+	/* 17 */ { "RLA", 0, 4 },
+	/* 18 */ { "JR n", 1, 8 },
+	/* 19 */ { "ADD HL,DE", 0, 8 },
+	/* 1A */ { "LD A,(DE)", 0, 8 },
+	/* 1B */ { "DEC DE", 0, 8 },
+	/* 1C */ { "INC E", 0, 4 },
+	/* 1D */ { "DEC E", 0, 4 },
+	/* 1E */ { "LD E,n", 1, 8 },
+	/* 1F */ { "RRA", 0, 4 },
+	/* 20 */ { "JR NZ,n", 1, 8 },
+	/* 21 */ { "LD HL,nn", 2, 12 },
+	/* 22 */ { "LDI (HL),A", 0, 8 },
+	/* 23 */ { "INC HL", 0, 8 },
+	/* 24 */ { "INC H", 0, 4 },
+	/* 25 */ { "DEC H", 0, 4 },
+	/* 26 */ { "LD H,n", 1, 8 },
+	/* 27 */ { "DAA", 0, 27 },
+	/* 28 */ { "JR Z,n", 1, 8 },
+	/* 29 */ { "ADD HL,HL", 0, 8 },
+	/* 2A */ { "LDI A,(HL)", 0, 8 },
+	/* 2B */ { "DEC HL", 0, 8 },
+	/* 2C */ { "INC L", 0, 4 },
+	/* 2D */ { "DEC L", 0, 4 },
+	/* 2E */ { "LD L,n", 1, 8 },
+	/* 2F */ { "CPL", 0, 4 },
+	/* 30 */ { "JR NC,n", 1, 8 },
+	/* 31 */ { "LD SP,nn", 2, 12 },
+	/* 32 */ { "LDD (HL),A", 0, 8 },
+	/* 33 */ { "INC SP", 0, 8 },
+	/* 34 */ { "INC (HL)", 0, 12 },
+	/* 35 */ { "DEC (HL)", 0, 12 },
+	/* 36 */ { "LD (HL),n", 1, 12 },
+	/* 37 */ { "SCF", 0, 4 },
+	/* 38 */ { "JR C,n", 1, 8 },
+	/* 39 */ { "ADD HL,SP", 0, 8 },
+	/* 3A */ { "LDD A,(HL)", 0, 8 },
+	/* 3B */ { "DEC SP", 0, 8 },
+	/* 3C */ { "INC A", 0, 4 },
+	/* 3D */ { "DEC A", 0, 4 },
+	/* 3E */ { "LD A,#", 1, 8 },
+	/* 3F */ { "CCF", 0, 4 },
+}};
+
+constexpr std::array<OpcodeInfo, 0x40> opcodeInfoHigh = {{
+	/* C0 */ { "RET NZ", 0, 8 },
+	/* C1 */ { "POP BC", 0, 12 },
+	/* C2 */ { "JP NZ,nn", 2, 12 },
+	/* C3 */ { "JP nn", 2, 12 },
+	/* C4 */ { "CALL NZ,nn", 2, 12 },
+	/* C5 */ { "PUSH BC", 0, 16 },
+	/* C6 */ { "ADD A,#", 1, 8 },
+	/* C7 */ { "RST 00", 0, 32 },
+	/* C8 */ { "RET Z", 0, 8 },
+	/* C9 */ { "RET", 0, 8 },
+	/* CA */ { "JP Z,nn", 2, 12 },
+	/* CB */ { nullptr, 0, 0 },
+	/* CC */ { "CALL Z,nn", 2, 12 },
+	/* CD */ { "CALL nn", 2, 12 },
+	/* CE */ { "ADC A,#", 1, 8 },
+	/* CF */ { "RST 08", 0, 32 },
+	/* D0 */ { "RET NC", 0, 8 },
+	/* D1 */ { "POP DE", 0, 12 },
+	/* D2 */ { "JP NC,nn", 2, 12 },
+	/* D3 */ { nullptr, 0, 0 },
+	/* D4 */ { "CALL NC,nn", 2, 12 },
+	/* D5 */ { "PUSH DE", 0, 16 },
+	/* D6 */ { "SUB A,#", 1, 8 },
+	/* D7 */ { "RST 10", 0, 32 },
+	/* D8 */ { "RET C", 0, 8 },
+	/* D9 */ { "RETI", 0, 8 },
+	/* DA */ { "JP C,nn", 2, 12 },
+	/* DB */ { nullptr, 0, 0 },
+	/* DC */ { "CALL C,nn", 2, 12 },
+	/* DD */ { nullptr, 0, 0 },
+	/* DE */ { "SBC A,#", 1, 8 },
+	/* DF */ { "RST 18", 0, 32 },
+	/* E0 */ { "LDH (n),A", 1, 12 },
+	/* E1 */ { "POP HL", 0, 12 },
+	/* E2 */ { "LD (C),A", 0, 8 },
+	/* E3 */ { nullptr, 0, 0 },
+	/* E4 */ { nullptr, 0, 0 },
+	/* E5 */ { "PUSH HL", 0, 16 },
+	/* E6 */ { "AND A,#", 1, 8 },
+	/* E7 */ { "RST 20", 0, 32 },
+	/* E8 */ { "ADD SP,n", 1, 16 },
+	/* E9 */ { "JP nn", 0, 4 },
+	/* EA */ { "LD (nn),A", 2, 16 },
+	/* EB */ { nullptr, 0, 0 },
+	/* EC */ { nullptr, 0, 0 },
+	/* ED */ { nullptr, 0, 0 },
+	/* EE */ { "XOR A,#", 1, 8 },
+	/* EF */ { "RST 28", 0, 32 },
+	/* F0 */ { "LDH A,(n)", 1, 12 },
+	/* F1 */ { "POP AF", 0, 12 },
+	/* F2 */ { "LD A,(C)", 0, 8 },
+	/* F3 */ { "DI", 0, 4 },
+	/* F4 */ { nullptr, 0, 0 },
+	/* F5 */ { "PUSH AF", 0, 16 },
+	/* F6 */ { "OR A,#", 1, 8 },
+	/* F7 */ { "RST 30", 0, 32 },
+	/* F8 */ { "LDHL SP,n", 1, 12 },
+	/* F9 */ { "LD SP,HL", 0, 8 },
+	/* FA */ { "LD A,(nn)", 2, 16 },
+	/* FB */ { "EI", 0, 4 },
+	/* FC */ { nullptr, 0, 0 },
+	/* FD */ { nullptr, 0, 0 },
+	/* FE */ { "CP A,#", 1, 8 },
+	/* FF */ { "RST 38", 0, 32 },
+}};
+
+constexpr OpcodeInfo MakeOpcodeInfo(const Mnemonic &mnemonic, const InstructionSpec &spec)
+{
+	return { mnemonic.text.data(), 0, spec.ticks };
+}
+
+constexpr std::array<OpcodeInfo, 256> MakeOpcodeInfo()
+{
+	std::array<OpcodeInfo, 256> info = {};
+
+	for (size_t opcode = 0; opcode < 0x40; opcode++)
+		info[opcode] = opcodeInfoLow[opcode];
+	for (size_t opcode = 0x40; opcode < 0xC0; opcode++)
+		info[opcode] = MakeOpcodeInfo(mnemonics[opcode], instructionSpecs[opcode]);
+	for (size_t opcode = 0xC0; opcode < 0x100; opcode++)
+		info[opcode] = opcodeInfoHigh[opcode - 0xC0];
+
+	return info;
+}
+
+constexpr std::array<OpcodeInfo, 256> MakeOpcodeInfoCB()
+{
+	std::array<OpcodeInfo, 256> info = {};
+
+	for (size_t opcode = 0; opcode < 0x100; opcode++)
+		info[opcode] = MakeOpcodeInfo(mnemonicsCB[opcode], instructionSpecsCB[opcode]);
+
+	return info;
+}
+
+}
+
+const std::array<OpcodeInfo, 256> opcodeInfo = MakeOpcodeInfo();
+
+const std::array<OpcodeInfo, 256> opcodeInfoCB = MakeOpcodeInfoCB();
+
+const std::array<OpcodeInfo, 256> opcodeInfo10 = {{
+	/* 00 */ { "STOP", 0, 4 },
+	/* 01 */ { nullptr, 0, 0 },
+	/* 02 */ { nullptr, 0, 0 },
+	/* 03 */ { nullptr, 0, 0 },
+	/* 04 */ { nullptr, 0, 0 },
+	/* 05 */ { nullptr, 0, 0 },
+	/* 06 */ { nullptr, 0, 0 },
+	/* 07 */ { nullptr, 0, 0 },
+	/* 08 */ { nullptr, 0, 0 },
+	/* 09 */ { nullptr, 0, 0 },
+	/* 0A */ { nullptr, 0, 0 },
+	/* 0B */ { nullptr, 0, 0 },
+	/* 0C */ { nullptr, 0, 0 },
+	/* 0D */ { nullptr, 0, 0 },
+	/* 0E */ { nullptr, 0, 0 },
+	/* 0F */ { nullptr, 0, 0 },
+	/* 10 */ { nullptr, 0, 0 },
+	/* 11 */ { nullptr, 0, 0 },
+	/* 12 */ { nullptr, 0, 0 },
+	/* 13 */ { nullptr, 0, 0 },
+	/* 14 */ { nullptr, 0, 0 },
+	/* 15 */ { nullptr, 0, 0 },
+	/* 16 */ { nullptr, 0, 0 },
+	/* 17 */ { nullptr, 0, 0 },
+	/* 18 */ { nullptr, 0, 0 },
+	/* 19 */ { nullptr, 0, 0 },
+	/* 1A */ { nullptr, 0, 0 },
+	/* 1B */ { nullptr, 0, 0 },
+	/* 1C */ { nullptr, 0, 0 },
+	/* 1D */ { nullptr, 0, 0 },
+	/* 1E */ { nullptr, 0, 0 },
+	/* 1F */ { nullptr, 0, 0 },
+	/* 20 */ { nullptr, 0, 0 },
+	/* 21 */ { nullptr, 0, 0 },
+	/* 22 */ { nullptr, 0, 0 },
+	/* 23 */ { nullptr, 0, 0 },
+	/* 24 */ { nullptr, 0, 0 },
+	/* 25 */ { nullptr, 0, 0 },
+	/* 26 */ { nullptr, 0, 0 },
+	/* 27 */ { nullptr, 0, 0 },
+	/* 28 */ { nullptr, 0, 0 },
+	/* 29 */ { nullptr, 0, 0 },
+	/* 2A */ { nullptr, 0, 0 },
+	/* 2B */ { nullptr, 0, 0 },
+	/* 2C */ { nullptr, 0, 0 },
+	/* 2D */ { nullptr, 0, 0 },
+	/* 2E */ { nullptr, 0, 0 },
+	/* 2F */ { nullptr, 0, 0 },
+	/* 30 */ { nullptr, 0, 0 },
+	/* 31 */ { nullptr, 0, 0 },
+	/* 32 */ { nullptr, 0, 0 },
+	/* 33 */ { nullptr, 0, 0 },
+	/* 34 */ { nullptr, 0, 0 },
+	/* 35 */ { nullptr, 0, 0 },
+	/* 36 */ { nullptr, 0, 0 },
+	/* 37 */ { nullptr, 0, 0 },
+	/* 38 */ { nullptr, 0, 0 },
+	/* 39 */ { nullptr, 0, 0 },
+	/* 3A */ { nullptr, 0, 0 },
+	/* 3B */ { nullptr, 0, 0 },
+	/* 3C */ { nullptr, 0, 0 },
+	/* 3D */ { nullptr, 0, 0 },
+	/* 3E */ { nullptr, 0, 0 },
+	/* 3F */ { nullptr, 0, 0 },
+	/* 40 */ { nullptr, 0, 0 },
+	/* 41 */ { nullptr, 0, 0 },
+	/* 42 */ { nullptr, 0, 0 },
+	/* 43 */ { nullptr, 0, 0 },
+	/* 44 */ { nullptr, 0, 0 },
+	/* 45 */ { nullptr, 0, 0 },
+	/* 46 */ { nullptr, 0, 0 },
+	/* 47 */ { nullptr, 0, 0 },
+	/* 48 */ { nullptr, 0, 0 },
+	/* 49 */ { nullptr, 0, 0 },
+	/* 4A */ { nullptr, 0, 0 },
+	/* 4B */ { nullptr, 0, 0 },
+	/* 4C */ { nullptr, 0, 0 },
+	/* 4D */ { nullptr, 0, 0 },
+	/* 4E */ { nullptr, 0, 0 },
+	/* 4F */ { nullptr, 0, 0 },
+	/* 50 */ { nullptr, 0, 0 },
+	/* 51 */ { nullptr, 0, 0 },
+	/* 52 */ { nullptr, 0, 0 },
+	/* 53 */ { nullptr, 0, 0 },
+	/* 54 */ { nullptr, 0, 0 },
+	/* 55 */ { nullptr, 0, 0 },
+	/* 56 */ { nullptr, 0, 0 },
+	/* 57 */ { nullptr, 0, 0 },
+	/* 58 */ { nullptr, 0, 0 },
+	/* 59 */ { nullptr, 0, 0 },
+	/* 5A */ { nullptr, 0, 0 },
+	/* 5B */ { nullptr, 0, 0 },
+	/* 5C */ { nullptr, 0, 0 },
+	/* 5D */ { nullptr, 0, 0 },
+	/* 5E */ { nullptr, 0, 0 },
+	/* 5F */ { nullptr, 0, 0 },
+	/* 60 */ { nullptr, 0, 0 },
+	/* 61 */ { nullptr, 0, 0 },
+	/* 62 */ { nullptr, 0, 0 },
+	/* 63 */ { nullptr, 0, 0 },
+	/* 64 */ { nullptr, 0, 0 },
+	/* 65 */ { nullptr, 0, 0 },
+	/* 66 */ { nullptr, 0, 0 },
+	/* 67 */ { nullptr, 0, 0 },
+	/* 68 */ { nullptr, 0, 0 },
+	/* 69 */ { nullptr, 0, 0 },
+	/* 6A */ { nullptr, 0, 0 },
+	/* 6B */ { nullptr, 0, 0 },
+	/* 6C */ { nullptr, 0, 0 },
+	/* 6D */ { nullptr, 0, 0 },
+	/* 6E */ { nullptr, 0, 0 },
+	/* 6F */ { nullptr, 0, 0 },
+	/* 70 */ { nullptr, 0, 0 },
+	/* 71 */ { nullptr, 0, 0 },
+	/* 72 */ { nullptr, 0, 0 },
+	/* 73 */ { nullptr, 0, 0 },
+	/* 74 */ { nullptr, 0, 0 },
+	/* 75 */ { nullptr, 0, 0 },
+	/* 76 */ { nullptr, 0, 0 },
+	/* 77 */ { nullptr, 0, 0 },
+	/* 78 */ { nullptr, 0, 0 },
+	/* 79 */ { nullptr, 0, 0 },
+	/* 7A */ { nullptr, 0, 0 },
+	/* 7B */ { nullptr, 0, 0 },
+	/* 7C */ { nullptr, 0, 0 },
+	/* 7D */ { nullptr, 0, 0 },
+	/* 7E */ { nullptr, 0, 0 },
+	/* 7F */ { nullptr, 0, 0 },
+	/* 80 */ { nullptr, 0, 0 },
+	/* 81 */ { nullptr, 0, 0 },
+	/* 82 */ { nullptr, 0, 0 },
+	/* 83 */ { nullptr, 0, 0 },
+	/* 84 */ { nullptr, 0, 0 },
+	/* 85 */ { nullptr, 0, 0 },
+	/* 86 */ { nullptr, 0, 0 },
+	/* 87 */ { nullptr, 0, 0 },
+	/* 88 */ { nullptr, 0, 0 },
+	/* 89 */ { nullptr, 0, 0 },
+	/* 8A */ { nullptr, 0, 0 },
+	/* 8B */ { nullptr, 0, 0 },
+	/* 8C */ { nullptr, 0, 0 },
+	/* 8D */ { nullptr, 0, 0 },
+	/* 8E */ { nullptr, 0, 0 },
+	/* 8F */ { nullptr, 0, 0 },
+	/* 90 */ { nullptr, 0, 0 },
+	/* 91 */ { nullptr, 0, 0 },
+	/* 92 */ { nullptr, 0, 0 },
+	/* 93 */ { nullptr, 0, 0 },
+	/* 94 */ { nullptr, 0, 0 },
+	/* 95 */ { nullptr, 0, 0 },
+	/* 96 */ { nullptr, 0, 0 },
+	/* 97 */ { nullptr, 0, 0 },
+	/* 98 */ { nullptr, 0, 0 },
+	/* 99 */ { nullptr, 0, 0 },
+	/* 9A */ { nullptr, 0, 0 },
+	/* 9B */ { nullptr, 0, 0 },
+	/* 9C */ { nullptr, 0, 0 },
+	/* 9D */ { nullptr, 0, 0 },
+	/* 9E */ { nullptr, 0, 0 },
+	/* 9F */ { nullptr, 0, 0 },
+	/* A0 */ { nullptr, 0, 0 },
+	/* A1 */ { nullptr, 0, 0 },
+	/* A2 */ { nullptr, 0, 0 },
+	/* A3 */ { nullptr, 0, 0 },
+	/* A4 */ { nullptr, 0, 0 },
+	/* A5 */ { nullptr, 0, 0 },
+	/* A6 */ { nullptr, 0, 0 },
+	/* A7 */ { nullptr, 0, 0 },
+	/* A8 */ { nullptr, 0, 0 },
+	/* A9 */ { nullptr, 0, 0 },
+	/* AA */ { nullptr, 0, 0 },
+	/* AB */ { nullptr, 0, 0 },
+	/* AC */ { nullptr, 0, 0 },
+	/* AD */ { nullptr, 0, 0 },
+	/* AE */ { nullptr, 0, 0 },
+	/* AF */ { nullptr, 0, 0 },
+	/* B0 */ { nullptr, 0, 0 },
+	/* B1 */ { nullptr, 0, 0 },
+	/* B2 */ { nullptr, 0, 0 },
+	/* B3 */ { nullptr, 0, 0 },
+	/* B4 */ { nullptr, 0, 0 },
+	/* B5 */ { nullptr, 0, 0 },
+	/* B6 */ { nullptr, 0, 0 },
+	/* B7 */ { nullptr, 0, 0 },
+	/* B8 */ { nullptr, 0, 0 },
+	/* B9 */ { nullptr, 0, 0 },
+	/* BA */ { nullptr, 0, 0 },
+	/* BB */ { nullptr, 0, 0 },
+	/* BC */ { nullptr, 0, 0 },
+	/* BD */ { nullptr, 0, 0 },
+	/* BE */ { nullptr, 0, 0 },
+	/* BF */ { nullptr, 0, 0 },
+	/* C0 */ { nullptr, 0, 0 },
+	/* C1 */ { nullptr, 0, 0 },
+	/* C2 */ { nullptr, 0, 0 },
+	/* C3 */ { nullptr, 0, 0 },
+	/* C4 */ { nullptr, 0, 0 },
+	/* C5 */ { nullptr, 0, 0 },
+	/* C6 */ { nullptr, 0, 0 },
+	/* C7 */ { nullptr, 0, 0 },
+	/* C8 */ { nullptr, 0, 0 },
+	/* C9 */ { nullptr, 0, 0 },
+	/* CA */ { nullptr, 0, 0 },
+	/* CB */ { nullptr, 0, 0 },
+	/* CC */ { nullptr, 0, 0 },
+	/* CD */ { nullptr, 0, 0 },
+	/* CE */ { nullptr, 0, 0 },
+	/* CF */ { nullptr, 0, 0 },
+	/* D0 */ { nullptr, 0, 0 },
+	/* D1 */ { nullptr, 0, 0 },
+	/* D2 */ { nullptr, 0, 0 },
+	/* D3 */ { nullptr, 0, 0 },
+	/* D4 */ { nullptr, 0, 0 },
+	/* D5 */ { nullptr, 0, 0 },
+	/* D6 */ { nullptr, 0, 0 },
+	/* D7 */ { nullptr, 0, 0 },
+	/* D8 */ { nullptr, 0, 0 },
+	/* D9 */ { nullptr, 0, 0 },
+	/* DA */ { nullptr, 0, 0 },
+	/* DB */ { nullptr, 0, 0 },
+	/* DC */ { nullptr, 0, 0 },
+	/* DD */ { nullptr, 0, 0 },
+	/* DE */ { nullptr, 0, 0 },
+	/* DF */ { nullptr, 0, 0 },
+	/* E0 */ { nullptr, 0, 0 },
+	/* E1 */ { nullptr, 0, 0 },
+	/* E2 */ { nullptr, 0, 0 },
+	/* E3 */ { nullptr, 0, 0 },
+	/* E4 */ { nullptr, 0, 0 },
+	/* E5 */ { nullptr, 0, 0 },
+	/* E6 */ { nullptr, 0, 0 },
+	/* E7 */ { nullptr, 0, 0 },
+	/* E8 */ { nullptr, 0, 0 },
+	/* E9 */ { nullptr, 0, 0 },
+	/* EA */ { nullptr, 0, 0 },
+	/* EB */ { nullptr, 0, 0 },
+	/* EC */ { nullptr, 0, 0 },
+	/* ED */ { nullptr, 0, 0 },
+	/* EE */ { nullptr, 0, 0 },
+	/* EF */ { nullptr, 0, 0 },
+	/* F0 */ { nullptr, 0, 0 },
+	/* F1 */ { nullptr, 0, 0 },
+	/* F2 */ { nullptr, 0, 0 },
+	/* F3 */ { nullptr, 0, 0 },
+	/* F4 */ { nullptr, 0, 0 },
+	/* F5 */ { nullptr, 0, 0 },
+	/* F6 */ { nullptr, 0, 0 },
+	/* F7 */ { nullptr, 0, 0 },
+	/* F8 */ { nullptr, 0, 0 },
+	/* F9 */ { nullptr, 0, 0 },
+	/* FA */ { nullptr, 0, 0 },
+	/* FB */ { nullptr, 0, 0 },
+	/* FC */ { nullptr, 0, 0 },
+	/* FD */ { nullptr, 0, 0 },
+	/* FE */ { nullptr, 0, 0 },
+	/* FF */ { nullptr, 0, 0 },
+}};
+
+}
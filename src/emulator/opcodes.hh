@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+namespace GBEmu::Emulator
+{
+
+// Mnemonic and timing metadata per opcode. Used for logging and
+// disassembly, and by the block cache to find instruction lengths. The
+// interpreter core itself never touches these tables. Entries of the
+// regular blocks are derived from instructionspec.hh.
+struct OpcodeInfo
+{
+	const char *name;
+	uint8_t operands;
+	uint8_t ticks;
+};
+
+extern const std::array<OpcodeInfo, 256> opcodeInfo;
+extern const std::array<OpcodeInfo, 256> opcodeInfoCB;
+extern const std::array<OpcodeInfo, 256> opcodeInfo10;
+
+}
\ No newline at end of file
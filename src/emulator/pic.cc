@@ -1,6 +1,7 @@
 #include "pic.hh"
 #include "io.hh"
 #include "log.hh"
+#include "state.hh"
 
 #include <cstdlib>
 #include <cassert>
@@ -31,7 +32,8 @@ Pic::Pic(Log &log, IO &io)
 
 void Pic::RaiseInterrupts(uint8_t mask)
 {
-	log_.Interrupt("Raise " + AsHexString(mask));
+	if (log_.InterruptEnabled())
+		log_.Interrupt("Raise " + AsHexString(mask));
 
 	assert(!(mask & 0xE0));
 	assert(mask & 0x1F);
@@ -55,7 +57,8 @@ uint8_t Pic::GetAndClearInterrupt()
 				// Clear highest priority bit.
 				if_ &= ~b;
 
-				log_.Interrupt("Get " + AsHexString(b) + " (IF=" + AsHexString(if_) + ")");
+				if (log_.InterruptEnabled())
+					log_.Interrupt("Get " + AsHexString(b) + " (IF=" + AsHexString(if_) + ")");
 				return b;
 			}
 		}
@@ -64,9 +67,16 @@ uint8_t Pic::GetAndClearInterrupt()
 	return 0;
 }
 
-bool Pic::InterruptsPending() const
+void Pic::SaveState(StateWriter &writer) const
 {
-	return if_ != 0;
+	writer.Write(ie_);
+	writer.Write(if_);
+}
+
+void Pic::LoadState(StateReader &reader)
+{
+	reader.Read(ie_);
+	reader.Read(if_);
 }
 
 }
\ No newline at end of file
@@ -13,6 +13,8 @@ namespace GBEmu::Emulator
 
 class Log;
 class IO;
+class StateWriter;
+class StateReader;
 
 class Pic
 {
@@ -21,7 +23,14 @@ public:
 
 	void RaiseInterrupts(uint8_t mask);
 	uint8_t GetAndClearInterrupt();
-	bool InterruptsPending() const;
+	bool InterruptsPending() const { return if_ != 0; }
+
+	// An enabled interrupt is pending, GetAndClearInterrupt() would
+	// return it. Cheap enough to poll before every instruction.
+	bool InterruptRequested() const { return if_ & ie_; }
+
+	void SaveState(StateWriter &writer) const;
+	void LoadState(StateReader &reader);
 
 private:
 	Log & log_;
@@ -1,4 +1,5 @@
 #include "ram.hh"
+#include "state.hh"
 
 #include <cassert>
 #include <iostream>
@@ -28,7 +29,6 @@ void Ram::Write(uint16_t offset, uint8_t data)
 {
 	assert(offset < size_);
 	memory_[offset] = data;
-	changed_ = true;
 }
 
 void Ram::Save(const std::string &filename)
@@ -55,4 +55,14 @@ void Ram::Save(const std::string &filename)
 	s.close();
 }
 
+void Ram::SaveState(StateWriter &writer) const
+{
+	writer.Write(memory_);
 }
+
+void Ram::LoadState(StateReader &reader)
+{
+	reader.Read(memory_);
+}
+
+}
\ No newline at end of file
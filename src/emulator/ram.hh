@@ -9,6 +9,9 @@
 namespace GBEmu::Emulator
 {
 
+class StateWriter;
+class StateReader;
+
 class Ram : public MemoryRegion
 {
 public:
@@ -18,18 +21,17 @@ public:
 	virtual uint8_t Read(uint16_t offset) override;
 	virtual void Write(uint16_t offset, uint8_t data) override;
 
+	virtual uint8_t *GetReadPage(uint16_t offset) override { return &memory_[offset]; }
+	virtual uint8_t *GetWritePage(uint16_t offset) override { return &memory_[offset]; }
+
 	void Save(const std::string &filename);
 
-	bool Changed() {
-		bool r = changed_;
-		changed_ = false;
-		return r;
-	}
+	void SaveState(StateWriter &writer) const;
+	void LoadState(StateReader &reader);
 
 private:
 	static constexpr size_t size_ = 8 * 1024;
 	std::array<uint8_t, size_> memory_;
-	bool changed_;
 };
 
 }
\ No newline at end of file
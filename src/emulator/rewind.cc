@@ -0,0 +1,202 @@
+#include "rewind.hh"
+
+#include <cassert>
+#include <cstring>
+
+namespace GBEmu::Emulator
+{
+
+namespace
+{
+
+// Byte runs shorter than this are cheaper to keep inside a literal
+// than to split the literal into two tokens.
+constexpr size_t minZeroRun = 4;
+
+void PutVarint(std::vector<uint8_t> &out, size_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(static_cast<uint8_t>(value) | 0x80);
+		value >>= 7;
+	}
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+size_t GetVarint(const uint8_t *&p)
+{
+	size_t value = 0;
+	int shift = 0;
+
+	for (;;)
+	{
+		const uint8_t b = *p++;
+		value |= size_t(b & 0x7F) << shift;
+		if (!(b & 0x80)) break;
+		shift += 7;
+	}
+
+	return value;
+}
+
+}
+
+RewindBuffer::RewindBuffer(size_t stateSize, size_t memoryBudget)
+	:stateSize_(stateSize),
+	memoryBudget_(memoryBudget),
+	memoryUsage_(0),
+	newest_(stateSize),
+	newestCycle_(0),
+	hasNewest_(false)
+{
+	assert(stateSize_ > 0);
+}
+
+void RewindBuffer::Push(uint64_t cycle, const uint8_t *state)
+{
+	assert(state);
+
+	if (hasNewest_)
+	{
+		assert(cycle >= newestCycle_);
+
+		// Encode into the scratch buffer first so the stored delta
+		// is allocated at its exact size.
+		Encode(state, newest_.data(), stateSize_, scratch_);
+		Delta delta = { newestCycle_, std::vector<uint8_t>(scratch_.begin(), scratch_.end()) };
+
+		memoryUsage_ += sizeof(Delta) + delta.data.capacity();
+		deltas_.push_back(std::move(delta));
+	}
+	else
+	{
+		memoryUsage_ += stateSize_;
+		hasNewest_ = true;
+	}
+
+	memcpy(newest_.data(), state, stateSize_);
+	newestCycle_ = cycle;
+
+	Evict();
+}
+
+void RewindBuffer::DropNewest()
+{
+	if (!hasNewest_) return;
+
+	if (deltas_.empty())
+	{
+		Clear();
+		return;
+	}
+
+	Delta &delta = deltas_.back();
+
+	Apply(delta.data, newest_.data(), stateSize_);
+	newestCycle_ = delta.cycle;
+
+	memoryUsage_ -= sizeof(Delta) + delta.data.capacity();
+	deltas_.pop_back();
+}
+
+void RewindBuffer::Clear()
+{
+	deltas_.clear();
+	hasNewest_ = false;
+	newestCycle_ = 0;
+	memoryUsage_ = 0;
+}
+
+void RewindBuffer::SetMemoryBudget(size_t memoryBudget)
+{
+	memoryBudget_ = memoryBudget;
+
+	Evict();
+}
+
+void RewindBuffer::Evict()
+{
+	// The newest state is always kept, even if it alone exceeds the budget.
+	while (!deltas_.empty() && memoryUsage_ > memoryBudget_)
+	{
+		memoryUsage_ -= sizeof(Delta) + deltas_.front().data.capacity();
+		deltas_.pop_front();
+	}
+}
+
+// Delta format, repeated until the end of the data:
+//   varint  number of unchanged bytes to skip
+//   varint  number of literal bytes
+//   ...     literal bytes (a ^ b)
+// Unchanged bytes at the end are not encoded at all.
+void RewindBuffer::Encode(const uint8_t *a, const uint8_t *b, size_t size, std::vector<uint8_t> &out)
+{
+	out.clear();
+
+	size_t i = 0;
+	while (i < size)
+	{
+		// Unchanged run, compared a word at a time.
+		const size_t runStart = i;
+		while (i + 8 <= size)
+		{
+			uint64_t wa, wb;
+			memcpy(&wa, a + i, 8);
+			memcpy(&wb, b + i, 8);
+			if (wa != wb) break;
+			i += 8;
+		}
+		while (i < size && a[i] == b[i])
+			i++;
+
+		if (i == size)
+			break;
+
+		// Changed run, ends at the next unchanged run worth skipping.
+		const size_t literalStart = i;
+		while (i < size)
+		{
+			if (a[i] != b[i]) {
+				i++;
+				continue;
+			}
+
+			size_t j = i;
+			while (j < size && j - i < minZeroRun && a[j] == b[j])
+				j++;
+
+			if (j - i >= minZeroRun || j == size)
+				break;
+
+			i = j;
+		}
+
+		PutVarint(out, literalStart - runStart);
+		PutVarint(out, i - literalStart);
+		for (size_t k = literalStart; k < i; k++)
+			out.push_back(a[k] ^ b[k]);
+	}
+}
+
+void RewindBuffer::Apply(const std::vector<uint8_t> &delta, uint8_t *state, size_t size)
+{
+	const uint8_t *p = delta.data();
+	const uint8_t * const end = p + delta.size();
+
+	size_t position = 0;
+	while (p < end)
+	{
+		position += GetVarint(p);
+		const size_t literals = GetVarint(p);
+
+		assert(position + literals <= size);
+
+		for (size_t k = 0; k < literals; k++)
+			state[position + k] ^= p[k];
+
+		p += literals;
+		position += literals;
+	}
+}
+
+}
\ No newline at end of file
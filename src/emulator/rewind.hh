@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace GBEmu::Emulator
+{
+
+// History of save states for rewinding. Only the newest state is kept
+// in full, every older one is stored as the XOR against its successor,
+// run-length encoded. Most of the state (RAM, VRAM, OAM) does not change
+// between frames, so a delta is mostly zero runs and encodes to a few
+// hundred bytes. The oldest deltas are dropped to stay within the budget.
+class RewindBuffer
+{
+public:
+	RewindBuffer(size_t stateSize, size_t memoryBudget);
+
+	void Push(uint64_t cycle, const uint8_t *state);
+	void DropNewest();
+	void Clear();
+
+	bool IsEmpty() const { return !hasNewest_; }
+	size_t GetCount() const { return hasNewest_ ? deltas_.size() + 1 : 0; }
+
+	const uint8_t *GetNewest() const { return newest_.data(); }
+	uint64_t GetNewestCycle() const { return newestCycle_; }
+
+	void SetMemoryBudget(size_t memoryBudget);
+	size_t GetMemoryUsage() const { return memoryUsage_; }
+
+private:
+	struct Delta
+	{
+		uint64_t cycle; // of the older state this delta restores
+		std::vector<uint8_t> data;
+	};
+
+	static void Encode(const uint8_t *a, const uint8_t *b, size_t size, std::vector<uint8_t> &out);
+	static void Apply(const std::vector<uint8_t> &delta, uint8_t *state, size_t size);
+
+	void Evict();
+
+	const size_t stateSize_;
+	size_t memoryBudget_;
+	size_t memoryUsage_;
+
+	std::vector<uint8_t> newest_;
+	uint64_t newestCycle_;
+	bool hasNewest_;
+
+	std::deque<Delta> deltas_; // oldest first
+	std::vector<uint8_t> scratch_;
+};
+
+}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "rom.hh"
 #include "log.hh"
+#include "state.hh"
 
 #include <iostream>
 #include <fstream>
@@ -37,6 +38,8 @@ void Rom::Load(size_t size, const void *data)
 
 	log_.Rom("Cartridge type: " + AsHexString(cartridgeType_));
 	log_.Rom("Size: " + AsHexString(romSize_));
+
+	RemapPages();
 }
 
 #if 0
@@ -140,6 +143,32 @@ uint8_t Rom::Read(uint16_t offset)
 	return 0;
 }
 
+uint8_t *Rom::GetReadPage(uint16_t offset)
+{
+	assert(offset < size_);
+
+	if (cartridgeType_ == 0x00) // None
+	{
+		return &data_[offset];
+	}
+	else if (cartridgeType_ == 0x01 || cartridgeType_ == 0x02 || cartridgeType_ == 0x03) // MBC1
+	{
+		if (offset <= 0x3FFF)
+		{
+			return &data_[offset];
+		}
+		else if (offset <= 0x7FFF)
+		{
+			size_t index = size_t(romBank_) * 16 * 1024 + offset - 0x4000;
+
+			return &data_[index];
+		}
+	}
+
+	// Unsupported cartridge, go through Read().
+	return nullptr;
+}
+
 void Rom::Write(uint16_t offset, uint8_t data)
 {
 	assert(offset < size_);
@@ -168,6 +197,8 @@ void Rom::Write(uint16_t offset, uint8_t data)
 			romBank_ = bankNumber;
 
 			log_.Rom("Selected ROM bank " + AsHexString(romBank_));
+
+			RemapPages();
 		}
 		else if (offset <= 0x5FFF) // RAM Bank Number OR Upper Bits of ROM Bank
 		{
@@ -184,4 +215,21 @@ void Rom::Write(uint16_t offset, uint8_t data)
 	}
 }
 
+uint16_t Rom::GetChecksum() const
+{
+	return (data_[0x14E] << 8) | data_[0x14F];
 }
+
+void Rom::SaveState(StateWriter &writer) const
+{
+	writer.Write(romBank_);
+}
+
+void Rom::LoadState(StateReader &reader)
+{
+	reader.Read(romBank_);
+
+	RemapPages();
+}
+
+}
\ No newline at end of file
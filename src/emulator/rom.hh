@@ -10,6 +10,8 @@ namespace GBEmu::Emulator
 {
 
 class Log;
+class StateWriter;
+class StateReader;
 
 class Rom : public MemoryRegion
 {
@@ -23,6 +25,14 @@ public:
 	virtual uint8_t Read(uint16_t offset) override;
 	virtual void Write(uint16_t offset, uint8_t data) override;
 
+	virtual uint8_t *GetReadPage(uint16_t offset) override;
+
+	void SaveState(StateWriter &writer) const;
+	void LoadState(StateReader &reader);
+
+	// Cartridge global checksum (0x14E-0x14F), identifies the ROM a state belongs to.
+	uint16_t GetChecksum() const;
+
 private:
 	static constexpr size_t size_ = 32 * 1024;
 
@@ -0,0 +1,184 @@
+#include "scheduler.hh"
+#include "state.hh"
+
+#include <cassert>
+#include <utility>
+
+namespace GBEmu::Emulator
+{
+
+Scheduler::Scheduler()
+	:now_(0),
+	nextDeadline_(never)
+{
+}
+
+Scheduler::EventId Scheduler::Register(SchedulerEventHandler handler)
+{
+	assert(handler);
+
+	events_.push_back(Event { handler, never, -1 });
+	heap_.reserve(events_.size());
+
+	return static_cast<EventId>(events_.size() - 1);
+}
+
+void Scheduler::Schedule(EventId event, uint64_t deadline)
+{
+	assert(event >= 0 && static_cast<size_t>(event) < events_.size());
+
+	Event &e = events_[event];
+
+	if (e.heapIndex < 0)
+	{
+		e.heapIndex = static_cast<int>(heap_.size());
+		heap_.push_back(event);
+	}
+
+	const uint64_t previous = e.deadline;
+	e.deadline = deadline;
+
+	if (deadline < previous)
+		SiftUp(e.heapIndex);
+	else
+		SiftDown(e.heapIndex);
+
+	UpdateNextDeadline();
+}
+
+void Scheduler::Cancel(EventId event)
+{
+	assert(event >= 0 && static_cast<size_t>(event) < events_.size());
+
+	if (events_[event].heapIndex < 0) return;
+
+	Remove(event);
+	UpdateNextDeadline();
+}
+
+bool Scheduler::IsScheduled(EventId event) const
+{
+	assert(event >= 0 && static_cast<size_t>(event) < events_.size());
+
+	return events_[event].heapIndex >= 0;
+}
+
+void Scheduler::Dispatch()
+{
+	// Handlers may schedule or cancel events, including the one being
+	// dispatched, so the event is taken off the heap before it runs.
+	while (!heap_.empty() && events_[heap_[0]].deadline <= now_)
+	{
+		const EventId event = heap_[0];
+		const uint64_t deadline = events_[event].deadline;
+
+		Remove(event);
+		events_[event].handler(deadline);
+	}
+
+	UpdateNextDeadline();
+}
+
+void Scheduler::Remove(EventId event)
+{
+	Event &e = events_[event];
+	const size_t index = static_cast<size_t>(e.heapIndex);
+	const size_t last = heap_.size() - 1;
+
+	if (index != last)
+	{
+		Swap(index, last);
+		heap_.pop_back();
+		SiftUp(index);
+		SiftDown(index);
+	}
+	else
+	{
+		heap_.pop_back();
+	}
+
+	e.heapIndex = -1;
+	e.deadline = never;
+}
+
+void Scheduler::SiftUp(size_t index)
+{
+	while (index > 0)
+	{
+		const size_t parent = (index - 1) / 2;
+		if (events_[heap_[parent]].deadline <= events_[heap_[index]].deadline)
+			break;
+
+		Swap(index, parent);
+		index = parent;
+	}
+}
+
+void Scheduler::SiftDown(size_t index)
+{
+	const size_t size = heap_.size();
+
+	for (;;)
+	{
+		const size_t left = index * 2 + 1;
+		const size_t right = left + 1;
+		size_t smallest = index;
+
+		if (left < size && events_[heap_[left]].deadline < events_[heap_[smallest]].deadline)
+			smallest = left;
+		if (right < size && events_[heap_[right]].deadline < events_[heap_[smallest]].deadline)
+			smallest = right;
+
+		if (smallest == index)
+			break;
+
+		Swap(index, smallest);
+		index = smallest;
+	}
+}
+
+void Scheduler::Swap(size_t a, size_t b)
+{
+	std::swap(heap_[a], heap_[b]);
+	events_[heap_[a]].heapIndex = static_cast<int>(a);
+	events_[heap_[b]].heapIndex = static_cast<int>(b);
+}
+
+void Scheduler::UpdateNextDeadline()
+{
+	nextDeadline_ = heap_.empty() ? never : events_[heap_[0]].deadline;
+}
+
+void Scheduler::SaveState(StateWriter &writer) const
+{
+	writer.Write(now_);
+
+	for (const Event &e : events_)
+		writer.Write(e.deadline);
+}
+
+void Scheduler::LoadState(StateReader &reader)
+{
+	reader.Read(now_);
+
+	heap_.clear();
+
+	for (size_t i = 0; i < events_.size(); i++)
+	{
+		Event &e = events_[i];
+
+		reader.Read(e.deadline);
+		e.heapIndex = -1;
+
+		if (e.deadline != never)
+		{
+			e.heapIndex = static_cast<int>(heap_.size());
+			heap_.push_back(static_cast<EventId>(i));
+			SiftUp(e.heapIndex);
+		}
+	}
+
+	UpdateNextDeadline();
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+namespace GBEmu::Emulator
+{
+
+class StateWriter;
+class StateReader;
+
+// Called with the cycle the event was scheduled for. Periodic events
+// reschedule themselves relative to that value so they do not drift.
+using SchedulerEventHandler = std::function<void(uint64_t deadline)>;
+
+// Global cycle counter and a min-heap of peripheral deadlines.
+// The emulator runs the cpu until the next deadline and then lets
+// Dispatch() fire everything that is due.
+class Scheduler
+{
+public:
+	using EventId = int;
+
+	static constexpr uint64_t never = std::numeric_limits<uint64_t>::max();
+
+	Scheduler();
+
+	EventId Register(SchedulerEventHandler handler);
+
+	void Schedule(EventId event, uint64_t deadline);
+	void Cancel(EventId event);
+	bool IsScheduled(EventId event) const;
+
+	uint64_t GetNow() const { return now_; }
+	uint64_t GetNextDeadline() const { return nextDeadline_; }
+
+	void Advance(uint32_t ticks) { now_ += ticks; }
+	void Dispatch();
+
+	// Events are identified by registration order, which is fixed by
+	// the emulator's construction order.
+	void SaveState(StateWriter &writer) const;
+	void LoadState(StateReader &reader);
+
+private:
+	struct Event
+	{
+		SchedulerEventHandler handler;
+		uint64_t deadline;
+		int heapIndex; // -1 when not scheduled
+	};
+
+	void Remove(EventId event);
+	void SiftUp(size_t index);
+	void SiftDown(size_t index);
+	void Swap(size_t a, size_t b);
+	void UpdateNextDeadline();
+
+	uint64_t now_;
+	uint64_t nextDeadline_;
+
+	std::vector<Event> events_;
+	std::vector<EventId> heap_;
+};
+
+}
\ No newline at end of file
@@ -1,59 +1,100 @@
 #include "sound.hh"
 #include "io.hh"
+#include "scheduler.hh"
+#include "state.hh"
 
 #include <cstdio>
 #include <cassert>
 #include <cstdint>
+#include <algorithm>
 
 namespace GBEmu::Emulator
 {
 
-Sound::Sound(IO &io, SoundDevice &soundDevice)
+Sound::Sound(IO &io, Scheduler &scheduler, SoundDevice &soundDevice)
 	:io_(io),
+	scheduler_(scheduler),
 	soundDevice_(soundDevice),
 
-	nr10_(0),
-	nr11_(0),
-	nr12_(0),
+	frameSequencerEvent_(-1),
+	frameSequencerStep_(0),
+
+	outputSuppressed_(false),
+
+	blockEvent_(-1),
+	sampleRate_(soundDevice.GetSampleRate()),
+	sampleCount_(0),
+	sampleClockStart_(scheduler.GetNow()),
+
+	// Registers start with the values the boot ROM leaves.
+	nr10_(0x80),
+	nr11_(0xBF),
+	nr12_(0xF3),
 	nr13_(0),
-	nr14_(0),
+	nr14_(0xBF),
 
-	nr21_(0),
+	nr21_(0x3F),
 	nr22_(0),
 	nr23_(0),
-	nr24_(0),
+	nr24_(0xBF),
 
-	nr30_(0),
-	nr31_(0),
-	nr32_(0),
+	nr30_(0x7F),
+	nr31_(0xFF),
+	nr32_(0x9F),
 	nr33_(0),
-	nr34_(0),
+	nr34_(0xBF),
+
+	nr41_(0xFF),
+	nr42_(0),
+	nr43_(0),
+	nr44_(0xBF),
 
-	c1ticks_(0),
+	nr50_(0x77),
+	nr51_(0xF3),
+	nr52_(0xF1),
+
+	// The envelopes are decoded from the registers like their write
+	// handlers do. The boot sound has faded out, channel 1 is on but at
+	// volume 0 until it is triggered again.
+	c1envelopeTimer_(0),
 	c1freq_(0),
-	c1initialVolume_(0),
+	c1initialVolume_((nr12_ & 0xF0) >> 4),
 	c1volume_(0),
-	c1direction_(0),
-	c1numberOfSweep_(0),
+	c1direction_((nr12_ & 0x08) >> 3),
+	c1numberOfSweep_(nr12_ & 0x07),
 
-	c2ticks_(0),
+	c2envelopeTimer_(0),
 	c2freq_(0),
-	c2initialVolume_(0),
+	c2initialVolume_((nr22_ & 0xF0) >> 4),
 	c2volume_(0),
-	c2direction_(0),
-	c2numberOfSweep_(0)
+	c2direction_((nr22_ & 0x08) >> 3),
+	c2numberOfSweep_(nr22_ & 0x07),
+
+	c4envelopeTimer_(0),
+	c4initialVolume_((nr42_ & 0xF0) >> 4),
+	c4volume_(0),
+	c4direction_((nr42_ & 0x08) >> 3),
+	c4numberOfSweep_(nr42_ & 0x07)
 
 {
-	for (int i = 0; i < 16; i++) pattern_[0] = 0;
+	for (int i = 0; i < 16; i++) pattern_[i] = 0;
+
+	// While powered off (NR52 bit 7) the channel and mixer registers
+	// ignore writes, NR52 itself and the wave pattern stay writable.
+	auto registerPowered = [&](const std::string &name, uint8_t offset, IOReadHandler read, IOWriteHandler write) {
+		io_.Register(name, offset, read, [this, write](uint8_t v) {
+			if (nr52_ & 0x80) write(v);
+		});
+	};
 
 	// Sound Channel 1
-	io_.Register("NR10", 0x10, [&]() { return nr10_; }, [&](uint8_t v) {
+	registerPowered("NR10", 0x10, [&]() { return nr10_; }, [&](uint8_t v) {
 		nr10_ = v;
 	});
-	io_.Register("NR11", 0x11, [&]() { return nr11_; }, [&](uint8_t v) {
+	registerPowered("NR11", 0x11, [&]() { return nr11_; }, [&](uint8_t v) {
 		nr11_ = v;
 	});
-	io_.Register("NR12", 0x12, [&]() { return nr12_; }, [&](uint8_t v) {
+	registerPowered("NR12", 0x12, [&]() { return nr12_; }, [&](uint8_t v) {
 		nr12_ = v;
 
 		c1initialVolume_ = (nr12_ & 0xF0) >> 4;
@@ -61,37 +102,38 @@ Sound::Sound(IO &io, SoundDevice &soundDevice)
 		c1numberOfSweep_ = nr12_ & 0x07;
 
 	});
-	io_.Register("NR13", 0x13, [&]() { return nr13_; }, [&](uint8_t v) {
+	registerPowered("NR13", 0x13, [&]() { return nr13_; }, [&](uint8_t v) {
 		nr13_ = v;
 
 		int x = ((nr14_ & 0x7) << 8) | nr13_;
 		int freq = 131072 / (2048 - x);
 
-		soundDevice_.SetFrequency1(freq);
+		Post(SE_FREQUENCY1, freq);
 
 	});
-	io_.Register("NR14", 0x14, [&]() { return nr14_; }, [&](uint8_t v) {
+	registerPowered("NR14", 0x14, [&]() { return nr14_; }, [&](uint8_t v) {
 		nr14_ = v;
 
 		if (nr14_ & 0x80) // Initial?
 		{
-			c1ticks_ = 0;
+			nr52_ |= 0x01;
+			c1envelopeTimer_ = c1numberOfSweep_;
 
 			c1volume_ = c1initialVolume_;
-			soundDevice_.SetVolume1(c1volume_);
+			Post(SE_VOLUME1, c1volume_);
 		}
 
 		int x = ((nr14_ & 0x7) << 8) | nr13_;
 		int freq = 131072 / (2048 - x);
-		soundDevice_.SetFrequency1(freq);
+		Post(SE_FREQUENCY1, freq);
 
 	});
 
 	// Sound Channel 2
-	io_.Register("NR21", 0x16, [&]() { return nr21_; }, [&](uint8_t v) {
+	registerPowered("NR21", 0x16, [&]() { return nr21_; }, [&](uint8_t v) {
 		nr21_ = v;
 	});
-	io_.Register("NR22", 0x17, [&]() { return nr22_; }, [&](uint8_t v) {
+	registerPowered("NR22", 0x17, [&]() { return nr22_; }, [&](uint8_t v) {
 		nr22_ = v;
 
 		c2initialVolume_ = (nr22_ & 0xF0) >> 4;
@@ -99,42 +141,44 @@ Sound::Sound(IO &io, SoundDevice &soundDevice)
 		c2numberOfSweep_ = nr22_ & 0x07;
 
 	});
-	io_.Register("NR23", 0x18, [&]() { return nr23_; }, [&](uint8_t v) {
+	registerPowered("NR23", 0x18, [&]() { return nr23_; }, [&](uint8_t v) {
 		nr23_ = v;
 
 		int x = ((nr24_ & 0x7) << 8) | nr23_;
 		int freq = 131072 / (2048 - x);
 
-		soundDevice_.SetFrequency2(freq);
+		Post(SE_FREQUENCY2, freq);
 
 	});
-	io_.Register("NR24", 0x19, [&]() { return nr24_; }, [&](uint8_t v) {
+	registerPowered("NR24", 0x19, [&]() { return nr24_; }, [&](uint8_t v) {
 		nr24_ = v;
 
 		if (nr24_ & 0x80) // Initial?
 		{
-			c2ticks_ = 0;
+			nr52_ |= 0x02;
+			c2envelopeTimer_ = c2numberOfSweep_;
 
 			c2volume_ = c2initialVolume_;
-			soundDevice_.SetVolume2(c2volume_);
+			Post(SE_VOLUME2, c2volume_);
 		}
 			
 		int x = ((nr24_ & 0x7) << 8) | nr23_;
 		int freq = 131072 / (2048 - x);
-		soundDevice_.SetFrequency2(freq);
+		Post(SE_FREQUENCY2, freq);
 
 	});
 
 	// Sound Channel 3
-	io_.Register("NR30", 0x1A, [&]() { return nr30_; }, [&](uint8_t v) {
+	registerPowered("NR30", 0x1A, [&]() { return nr30_; }, [&](uint8_t v) {
 		nr30_ = v;
 
-		soundDevice_.SetPlayback3((nr30_ & 0x80) != 0);
+		if (!(nr30_ & 0x80)) nr52_ &= ~0x04;
+		Post(SE_PLAYBACK3, (nr30_ & 0x80) != 0);
 	});
-	io_.Register("NR31", 0x1B, [&]() { return nr31_; }, [&](uint8_t v) {
+	registerPowered("NR31", 0x1B, [&]() { return nr31_; }, [&](uint8_t v) {
 		nr31_ = v;
 	});
-	io_.Register("NR32", 0x1C, [&]() { return nr32_; }, [&](uint8_t v) {
+	registerPowered("NR32", 0x1C, [&]() { return nr32_; }, [&](uint8_t v) {
 		nr32_ = v;
 
 		//if (nr34_ & 0x80)
@@ -143,12 +187,12 @@ Sound::Sound(IO &io, SoundDevice &soundDevice)
 			int freq = 65536 / (2048 - x);
 			int volume = (nr32_ & 0x60) >> 5;
 
-			soundDevice_.SetFrequency3(freq);
-			soundDevice_.SetVolume3(volume);
-			soundDevice_.SetPattern3(pattern_);
+			Post(SE_FREQUENCY3, freq);
+			Post(SE_VOLUME3, volume);
+			PostPattern3();
 		}
 	});
-	io_.Register("NR33", 0x1D, [&]() { return nr33_; }, [&](uint8_t v) {
+	registerPowered("NR33", 0x1D, [&]() { return nr33_; }, [&](uint8_t v) {
 		nr33_ = v;
 
 		//if (nr34_ & 0x80)
@@ -157,23 +201,25 @@ Sound::Sound(IO &io, SoundDevice &soundDevice)
 			int freq = 65536 / (2048 - x);
 			int volume = (nr32_ & 0x60) >> 5;
 
-			soundDevice_.SetFrequency3(freq);
-			soundDevice_.SetVolume3(volume);
-			soundDevice_.SetPattern3(pattern_);
+			Post(SE_FREQUENCY3, freq);
+			Post(SE_VOLUME3, volume);
+			PostPattern3();
 		}
 	});
-	io_.Register("NR34", 0x1E, [&]() { return nr34_; }, [&](uint8_t v) {
+	registerPowered("NR34", 0x1E, [&]() { return nr34_; }, [&](uint8_t v) {
 		nr34_ = v;
 
 		if (nr34_ & 0x80)
 		{
+			if (nr30_ & 0x80) nr52_ |= 0x04;
+
 			int x = ((nr34_ & 0x7) << 8) | nr33_;
 			int freq = 65536 / (2048 - x);
 			int volume = (nr32_ & 0x60) >> 5;
 
-			soundDevice_.SetFrequency3(freq);
-			soundDevice_.SetVolume3(volume);
-			soundDevice_.SetPattern3(pattern_);
+			Post(SE_FREQUENCY3, freq);
+			Post(SE_VOLUME3, volume);
+			PostPattern3();
 		}
 
 	});
@@ -185,60 +231,394 @@ Sound::Sound(IO &io, SoundDevice &soundDevice)
 	}
 
 	// Sound Channel 4
-	io_.Register("NR41", 0x20, []() { return 0; }, [](uint8_t v) {});
-	io_.Register("NR42", 0x21, []() { return 0; }, [](uint8_t v) {});
-	io_.Register("NR43", 0x22, []() { return 0; }, [](uint8_t v) {});
-	io_.Register("NR44", 0x23, []() { return 0; }, [](uint8_t v) {});
+	registerPowered("NR41", 0x20, [&]() { return nr41_; }, [&](uint8_t v) {
+		nr41_ = v;
+	});
+	registerPowered("NR42", 0x21, [&]() { return nr42_; }, [&](uint8_t v) {
+		nr42_ = v;
+
+		c4initialVolume_ = (nr42_ & 0xF0) >> 4;
+		c4direction_ = (nr42_ & 0x08) >> 3;
+		c4numberOfSweep_ = nr42_ & 0x07;
+
+	});
+	registerPowered("NR43", 0x22, [&]() { return nr43_; }, [&](uint8_t v) {
+		nr43_ = v;
+
+		Post(SE_FREQUENCY4, GetFrequency4());
+		Post(SE_WIDTH4, (nr43_ & 0x08) != 0);
+
+	});
+	registerPowered("NR44", 0x23, [&]() { return nr44_; }, [&](uint8_t v) {
+		nr44_ = v;
+
+		if (nr44_ & 0x80) // Initial?
+		{
+			nr52_ |= 0x08;
+			c4envelopeTimer_ = c4numberOfSweep_;
+
+			c4volume_ = c4initialVolume_;
+			Post(SE_VOLUME4, c4volume_);
+			Post(SE_RESTART4, 0);
+		}
+
+	});
 
 	// Sound Control
-	io_.Register("NR50", 0x24, []() { return 0; }, [](uint8_t v) {});
-	io_.Register("NR51", 0x25, []() { return 0; }, [](uint8_t v) {});
-	io_.Register("NR52", 0x26, []() { return 0; }, [](uint8_t v) {});
+	registerPowered("NR50", 0x24, [&]() { return nr50_; }, [&](uint8_t v) {
+		nr50_ = v;
+
+		Post(SE_MIXER, nr50_ | (nr51_ << 8));
+	});
+	registerPowered("NR51", 0x25, [&]() { return nr51_; }, [&](uint8_t v) {
+		nr51_ = v;
+
+		Post(SE_MIXER, nr50_ | (nr51_ << 8));
+	});
+	io_.Register("NR52", 0x26, [&]() { return uint8_t(nr52_ | 0x70); }, [&](uint8_t v) {
+		if (!(v & 0x80))
+			PowerOff();
+		else
+			nr52_ |= 0x80;
+	});
+
+	frameSequencerEvent_ = scheduler_.Register([&](uint64_t deadline) { FrameSequencerStep(deadline); });
+	scheduler_.Schedule(frameSequencerEvent_, scheduler_.GetNow() + frameSequencerTicks_);
+
+	// Devices without output (headless) report a sample rate of 0,
+	// no sample clock is needed for them.
+	blockEvent_ = scheduler_.Register([&](uint64_t deadline) { BlockClock(deadline); });
+	if (sampleRate_ > 0)
+	{
+		events_.reserve(256);
+		scheduler_.Schedule(blockEvent_, GetSampleTick(blockSamples_));
+	}
+
+	UpdateDevice();
+}
+
+void Sound::Post(SoundEventType type, int value)
+{
+	SoundEvent event = { scheduler_.GetNow(), type, value };
+
+	if (sampleRate_ > 0)
+		events_.push_back(event);
+	else
+		Apply(event);
+}
+
+void Sound::PostPattern3()
+{
+	if (sampleRate_ > 0)
+	{
+		std::array<uint8_t, 16> pattern;
+		std::copy(pattern_, pattern_ + 16, pattern.begin());
+		patterns_.push_back(pattern);
+		Post(SE_PATTERN3, static_cast<int>(patterns_.size() - 1));
+	}
+	else
+	{
+		soundDevice_.SetPattern3(pattern_);
+	}
 }
 
-void Sound::Tick(int consumedTicks)
+void Sound::Apply(const SoundEvent &event)
+{
+	switch (event.type)
+	{
+	case SE_FREQUENCY1: soundDevice_.SetFrequency1(event.value); break;
+	case SE_VOLUME1:    soundDevice_.SetVolume1(event.value);    break;
+	case SE_FREQUENCY2: soundDevice_.SetFrequency2(event.value); break;
+	case SE_VOLUME2:    soundDevice_.SetVolume2(event.value);    break;
+	case SE_FREQUENCY3: soundDevice_.SetFrequency3(event.value); break;
+	case SE_VOLUME3:    soundDevice_.SetVolume3(event.value);    break;
+	case SE_PATTERN3:   soundDevice_.SetPattern3(patterns_[event.value].data()); break;
+	case SE_PLAYBACK3:  soundDevice_.SetPlayback3(event.value != 0); break;
+	case SE_FREQUENCY4: soundDevice_.SetFrequency4(event.value); break;
+	case SE_VOLUME4:    soundDevice_.SetVolume4(event.value);    break;
+	case SE_WIDTH4:     soundDevice_.SetWidth4(event.value != 0); break;
+	case SE_RESTART4:   soundDevice_.Restart4();                 break;
+	case SE_MIXER:      soundDevice_.SetMixer(event.value & 0xFF, event.value >> 8); break;
+	}
+}
+
+int Sound::GetFrequency4() const
+{
+	// 524288 Hz / r / 2^(s+1), with r = 0 counting as 0.5.
+	// Shifts 14 and 15 stop the LFSR.
+	const int r = nr43_ & 0x07;
+	const int s = nr43_ >> 4;
+	if (s >= 14) return 0;
+
+	return (r ? 524288 / r : 1048576) >> (s + 1);
+}
+
+void Sound::PowerOff()
+{
+	// Powering off clears all channel and mixer registers.
+	nr10_ = nr11_ = nr12_ = nr13_ = nr14_ = 0;
+	nr21_ = nr22_ = nr23_ = nr24_ = 0;
+	nr30_ = nr31_ = nr32_ = nr33_ = nr34_ = 0;
+	nr41_ = nr42_ = nr43_ = nr44_ = 0;
+	nr50_ = nr51_ = nr52_ = 0;
+
+	c1initialVolume_ = c1volume_ = c1direction_ = c1numberOfSweep_ = 0;
+	c2initialVolume_ = c2volume_ = c2direction_ = c2numberOfSweep_ = 0;
+	c4initialVolume_ = c4volume_ = c4direction_ = c4numberOfSweep_ = 0;
+
+	Post(SE_VOLUME1, 0);
+	Post(SE_VOLUME2, 0);
+	Post(SE_PLAYBACK3, 0);
+	Post(SE_VOLUME4, 0);
+	Post(SE_MIXER, 0);
+}
+
+// The volume stays within 0-15, the envelope stops at either end.
+bool Sound::StepEnvelope(int &volume, int direction)
+{
+	if (direction) {
+		if (volume >= 15) return false;
+		volume++;
+	}
+	else {
+		if (volume <= 0) return false;
+		volume--;
+	}
+
+	return true;
+}
+
+void Sound::FrameSequencerStep(uint64_t deadline)
 {
 	// CPU clock: 4.194304MHz
-	const int c1TickOverflow = 4194304 / 64; // 64 Hz
-	const int c2TickOverflow = 4194304 / 64; // 64 Hz
+	// The frame sequencer runs at 512 Hz, the volume envelope
+	// is clocked on step 7 (64 Hz).
+	scheduler_.Schedule(frameSequencerEvent_, deadline + frameSequencerTicks_);
+
+	frameSequencerStep_ = (frameSequencerStep_ + 1) % 8;
+	if (frameSequencerStep_ != 7)
+		return;
 
-	if (c1numberOfSweep_)
+	if (c1numberOfSweep_ && --c1envelopeTimer_ <= 0)
 	{
-		c1ticks_ += consumedTicks;
-		if (c1ticks_ > c1TickOverflow * c1numberOfSweep_)
-		{
-			c1ticks_ = 0;
+		c1envelopeTimer_ = c1numberOfSweep_;
 
-			if (c1direction_) {
-				c1volume_ = (c1volume_ + 1) % 16;
-			}
-			else {
-				c1volume_ = (c1volume_ - 1) % 16;
-			}
+		if (StepEnvelope(c1volume_, c1direction_))
+			Post(SE_VOLUME1, c1volume_);
+	}
 
-			soundDevice_.SetVolume1(c1volume_);
-		}
+	if (c2numberOfSweep_ && --c2envelopeTimer_ <= 0)
+	{
+		c2envelopeTimer_ = c2numberOfSweep_;
+
+		if (StepEnvelope(c2volume_, c2direction_))
+			Post(SE_VOLUME2, c2volume_);
 	}
 
-	if (c2numberOfSweep_)
+	if (c4numberOfSweep_ && --c4envelopeTimer_ <= 0)
 	{
-		c2ticks_ += consumedTicks;
-		if (c2ticks_ > c2TickOverflow * c2numberOfSweep_)
-		{
-			c2ticks_ = 0;
+		c4envelopeTimer_ = c4numberOfSweep_;
+
+		if (StepEnvelope(c4volume_, c4direction_))
+			Post(SE_VOLUME4, c4volume_);
+	}
+}
+
+void Sound::BlockClock(uint64_t deadline)
+{
+	RenderUntil(deadline);
+
+	scheduler_.Schedule(blockEvent_, GetSampleTick(sampleCount_ + blockSamples_));
+}
+
+void Sound::SetOutputSuppressed(bool suppressed)
+{
+	// Samples up to now belong to the old setting.
+	Flush();
+
+	outputSuppressed_ = suppressed;
+}
 
-			if (c2direction_) {
-				c2volume_ = (c2volume_ + 1) % 16;
-			}
-			else {
-				c2volume_ = (c2volume_ - 1) % 16;
-			}
+void Sound::Flush()
+{
+	if (sampleRate_ > 0)
+		RenderUntil(scheduler_.GetNow());
+}
+
+void Sound::RenderUntil(uint64_t tick)
+{
+	// Sample n is due at GetSampleTick(n), so the samples due up to a
+	// tick are those with n <= (tick - start) * rate / clock.
+	auto samplesUntil = [&](uint64_t t) {
+		return (t - sampleClockStart_) * sampleRate_ / cpuClock_;
+	};
 
-			soundDevice_.SetVolume2(c2volume_);
+	for (const SoundEvent &event : events_)
+	{
+		const uint64_t samples = samplesUntil(event.tick);
+		if (samples > sampleCount_)
+		{
+			if (!outputSuppressed_)
+				soundDevice_.Render(static_cast<int>(samples - sampleCount_));
+			sampleCount_ = samples;
 		}
+
+		Apply(event);
 	}
 
-	soundDevice_.Tick(consumedTicks);
+	events_.clear();
+	patterns_.clear();
+
+	const uint64_t samples = samplesUntil(tick);
+	if (samples > sampleCount_)
+	{
+		if (!outputSuppressed_)
+			soundDevice_.Render(static_cast<int>(samples - sampleCount_));
+		sampleCount_ = samples;
+	}
+}
+
+uint64_t Sound::GetSampleTick(uint64_t sample) const
+{
+	// ceil(n * clock / rate), computed from the sample count so the
+	// rounding does not accumulate.
+	return sampleClockStart_ + (sample * cpuClock_ + sampleRate_ - 1) / sampleRate_;
+}
+
+void Sound::SaveState(StateWriter &writer) const
+{
+	writer.Write(frameSequencerStep_);
+	writer.Write(sampleCount_);
+	writer.Write(sampleClockStart_);
+
+	writer.Write(nr10_);
+	writer.Write(nr11_);
+	writer.Write(nr12_);
+	writer.Write(nr13_);
+	writer.Write(nr14_);
+
+	writer.Write(nr21_);
+	writer.Write(nr22_);
+	writer.Write(nr23_);
+	writer.Write(nr24_);
+
+	writer.Write(nr30_);
+	writer.Write(nr31_);
+	writer.Write(nr32_);
+	writer.Write(nr33_);
+	writer.Write(nr34_);
+	writer.Write(pattern_);
+
+	writer.Write(nr41_);
+	writer.Write(nr42_);
+	writer.Write(nr43_);
+	writer.Write(nr44_);
+
+	writer.Write(nr50_);
+	writer.Write(nr51_);
+	writer.Write(nr52_);
+
+	writer.Write(c1envelopeTimer_);
+	writer.Write(c1freq_);
+	writer.Write(c1initialVolume_);
+	writer.Write(c1volume_);
+	writer.Write(c1direction_);
+	writer.Write(c1numberOfSweep_);
+
+	writer.Write(c2envelopeTimer_);
+	writer.Write(c2freq_);
+	writer.Write(c2initialVolume_);
+	writer.Write(c2volume_);
+	writer.Write(c2direction_);
+	writer.Write(c2numberOfSweep_);
+
+	writer.Write(c4envelopeTimer_);
+	writer.Write(c4initialVolume_);
+	writer.Write(c4volume_);
+	writer.Write(c4direction_);
+	writer.Write(c4numberOfSweep_);
+}
+
+void Sound::LoadState(StateReader &reader)
+{
+	reader.Read(frameSequencerStep_);
+	reader.Read(sampleCount_);
+	reader.Read(sampleClockStart_);
+
+	reader.Read(nr10_);
+	reader.Read(nr11_);
+	reader.Read(nr12_);
+	reader.Read(nr13_);
+	reader.Read(nr14_);
+
+	reader.Read(nr21_);
+	reader.Read(nr22_);
+	reader.Read(nr23_);
+	reader.Read(nr24_);
+
+	reader.Read(nr30_);
+	reader.Read(nr31_);
+	reader.Read(nr32_);
+	reader.Read(nr33_);
+	reader.Read(nr34_);
+	reader.Read(pattern_);
+
+	reader.Read(nr41_);
+	reader.Read(nr42_);
+	reader.Read(nr43_);
+	reader.Read(nr44_);
+
+	reader.Read(nr50_);
+	reader.Read(nr51_);
+	reader.Read(nr52_);
+
+	reader.Read(c1envelopeTimer_);
+	reader.Read(c1freq_);
+	reader.Read(c1initialVolume_);
+	reader.Read(c1volume_);
+	reader.Read(c1direction_);
+	reader.Read(c1numberOfSweep_);
+
+	reader.Read(c2envelopeTimer_);
+	reader.Read(c2freq_);
+	reader.Read(c2initialVolume_);
+	reader.Read(c2volume_);
+	reader.Read(c2direction_);
+	reader.Read(c2numberOfSweep_);
+
+	reader.Read(c4envelopeTimer_);
+	reader.Read(c4initialVolume_);
+	reader.Read(c4volume_);
+	reader.Read(c4direction_);
+	reader.Read(c4numberOfSweep_);
+
+	// Changes still pending belong to the timeline that was left.
+	events_.clear();
+	patterns_.clear();
+
+	UpdateDevice();
+}
+
+void Sound::UpdateDevice()
+{
+	// The device only sees register writes, bring it in line
+	// with the registers after they changed behind its back.
+	soundDevice_.SetFrequency1(131072 / (2048 - (((nr14_ & 0x7) << 8) | nr13_)));
+	soundDevice_.SetVolume1(c1volume_);
+
+	soundDevice_.SetFrequency2(131072 / (2048 - (((nr24_ & 0x7) << 8) | nr23_)));
+	soundDevice_.SetVolume2(c2volume_);
+
+	soundDevice_.SetFrequency3(65536 / (2048 - (((nr34_ & 0x7) << 8) | nr33_)));
+	soundDevice_.SetVolume3((nr32_ & 0x60) >> 5);
+	soundDevice_.SetPattern3(pattern_);
+	soundDevice_.SetPlayback3((nr30_ & 0x80) != 0);
+
+	soundDevice_.SetFrequency4(GetFrequency4());
+	soundDevice_.SetVolume4(c4volume_);
+	soundDevice_.SetWidth4((nr43_ & 0x08) != 0);
+
+	soundDevice_.SetMixer(nr50_, nr51_);
 }
 
 }
\ No newline at end of file
@@ -1,11 +1,16 @@
 #pragma once
 
 #include <cstdint>
+#include <array>
+#include <vector>
 
 namespace GBEmu::Emulator
 {
 
 class IO;
+class Scheduler;
+class StateWriter;
+class StateReader;
 
 class SoundDevice
 {
@@ -18,21 +23,99 @@ public:
 	virtual void SetVolume3(int volume) = 0;
 	virtual void SetPattern3(uint8_t *pattern) = 0;
 	virtual void SetPlayback3(bool playback) = 0;
-
-	virtual void Tick(int consumedTicks) = 0;
+	virtual void SetFrequency4(int freq) = 0; // LFSR clocks per second, 0 stops it.
+	virtual void SetVolume4(int volume) = 0;
+	virtual void SetWidth4(bool shortWidth) = 0; // 7 bit instead of 15 bit LFSR.
+	virtual void Restart4() = 0;
+
+	// NR50 master volume and NR51 channel routing.
+	virtual void SetMixer(uint8_t volume, uint8_t routing) = 0;
+
+	// Output sample rate in Hz. Sound renders the output in blocks of
+	// samples, the setters above are called in between, right before the
+	// first sample they apply to. 0 means the device produces no output,
+	// then Render() is never called and the setters apply immediately.
+	virtual int GetSampleRate() const = 0;
+	virtual void Render(int samples) = 0;
 };
 
 class Sound
 {
 public:
-	Sound(IO &io, SoundDevice &soundDevice);
+	Sound(IO &io, Scheduler &scheduler, SoundDevice &soundDevice);
+
+	void SaveState(StateWriter &writer) const;
+	void LoadState(StateReader &reader);
+
+	// While suppressed no samples are produced. The device still sees
+	// register changes, LoadState() brings it back in line afterwards.
+	void SetOutputSuppressed(bool suppressed);
 
-	void Tick(int consumedTicks);
+	// Renders all samples due up to now.
+	void Flush();
 
 private:
+	enum SoundEventType
+	{
+		SE_FREQUENCY1,
+		SE_VOLUME1,
+		SE_FREQUENCY2,
+		SE_VOLUME2,
+		SE_FREQUENCY3,
+		SE_VOLUME3,
+		SE_PATTERN3,
+		SE_PLAYBACK3,
+		SE_FREQUENCY4,
+		SE_VOLUME4,
+		SE_WIDTH4,
+		SE_RESTART4,
+		SE_MIXER, // NR50 | NR51 << 8
+	};
+
+	// Change of a device parameter, applied when the samples up to its
+	// tick have been rendered.
+	struct SoundEvent
+	{
+		uint64_t tick;
+		SoundEventType type;
+		int value; // Index into patterns_ for SE_PATTERN3.
+	};
+
+	void Post(SoundEventType type, int value);
+	void PostPattern3();
+	void Apply(const SoundEvent &event);
+
+	int GetFrequency4() const;
+	void PowerOff();
+	static bool StepEnvelope(int &volume, int direction);
+
+	void UpdateDevice();
+	void FrameSequencerStep(uint64_t deadline);
+	void BlockClock(uint64_t deadline);
+	void RenderUntil(uint64_t tick);
+	uint64_t GetSampleTick(uint64_t sample) const;
+
+	static constexpr uint64_t cpuClock_ = 4194304;
+	static constexpr int frameSequencerTicks_ = 8192; // 512 Hz
+	static constexpr int blockSamples_ = 512;
+
 	IO & io_;
+	Scheduler &scheduler_;
 	SoundDevice &soundDevice_;
 
+	int frameSequencerEvent_;
+	int frameSequencerStep_;
+
+	bool outputSuppressed_;
+
+	int blockEvent_;
+	int sampleRate_;
+	uint64_t sampleCount_; // Samples rendered since sampleClockStart_.
+	uint64_t sampleClockStart_;
+
+	std::vector<SoundEvent> events_;
+	std::vector<std::array<uint8_t, 16>> patterns_;
+
 	uint8_t nr10_;
 	uint8_t nr11_;
 	uint8_t nr12_;
@@ -51,20 +134,34 @@ private:
 	uint8_t nr34_;
 	uint8_t pattern_[16];
 
-	int c1ticks_;
+	uint8_t nr41_;
+	uint8_t nr42_;
+	uint8_t nr43_;
+	uint8_t nr44_;
+
+	uint8_t nr50_;
+	uint8_t nr51_;
+	uint8_t nr52_; // Power in bit 7, channels on in bits 0-3.
+
+	int c1envelopeTimer_;
 	int c1freq_;
 	int c1initialVolume_;
 	int c1volume_;
 	int c1direction_;
 	int c1numberOfSweep_;
 
-	int c2ticks_;
+	int c2envelopeTimer_;
 	int c2freq_;
 	int c2initialVolume_;
 	int c2volume_;
 	int c2direction_;
 	int c2numberOfSweep_;
 
+	int c4envelopeTimer_;
+	int c4initialVolume_;
+	int c4volume_;
+	int c4direction_;
+	int c4numberOfSweep_;
 
 };
 
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace GBEmu::Emulator
+{
+
+// Save states are a flat binary blob, every component copies its fields
+// in a fixed order. There is no per-field tagging, so any change to what
+// a component writes must bump Emulator's state version.
+
+class StateWriter
+{
+public:
+	// Without a buffer the writer only counts bytes, used to
+	// determine the state size up front.
+	StateWriter()
+		:data_(nullptr), size_(std::numeric_limits<size_t>::max()), position_(0), failed_(false) { }
+
+	StateWriter(void *data, size_t size)
+		:data_(static_cast<uint8_t*>(data)), size_(size), position_(0), failed_(false) { }
+
+	template<typename T>
+	void Write(const T &value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "state fields must be trivially copyable");
+		WriteBytes(&value, sizeof(T));
+	}
+
+	void WriteBytes(const void *data, size_t size)
+	{
+		if (failed_ || size > size_ - position_) {
+			failed_ = true;
+			return;
+		}
+
+		if (data_)
+			memcpy(data_ + position_, data, size);
+		position_ += size;
+	}
+
+	size_t GetPosition() const { return position_; }
+	bool Failed() const { return failed_; }
+
+private:
+	uint8_t * const data_;
+	const size_t size_;
+	size_t position_;
+	bool failed_;
+};
+
+class StateReader
+{
+public:
+	StateReader(const void *data, size_t size)
+		:data_(static_cast<const uint8_t*>(data)), size_(size), position_(0), failed_(false) { }
+
+	template<typename T>
+	void Read(T &value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "state fields must be trivially copyable");
+		ReadBytes(&value, sizeof(T));
+	}
+
+	void ReadBytes(void *data, size_t size)
+	{
+		if (failed_ || size > size_ - position_) {
+			failed_ = true;
+			return;
+		}
+
+		memcpy(data, data_ + position_, size);
+		position_ += size;
+	}
+
+	size_t GetPosition() const { return position_; }
+	bool Failed() const { return failed_; }
+
+private:
+	const uint8_t * const data_;
+	const size_t size_;
+	size_t position_;
+	bool failed_;
+};
+
+}
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include "io.hh"
 #include "pic.hh"
 #include "log.hh"
+#include "scheduler.hh"
+#include "state.hh"
 
 #include <cstdio>
 
@@ -11,35 +13,43 @@
 namespace GBEmu::Emulator
 {
 
-Timer::Timer(Log &log, IO &io, Pic &pic)
+Timer::Timer(Log &log, IO &io, Pic &pic, Scheduler &scheduler)
 	:log_(log),
 	io_(io),
 	pic_(pic),
-	divValue_(0),
+	scheduler_(scheduler),
+	divBase_(scheduler.GetNow()),
+	timaUpdate_(scheduler.GetNow()),
 	timaValue_(0),
 	tmaValue_(0),
 	tacValue_(0),
-	divTicks_(0),
-	timaTicks_(0)
+	overflowEvent_(-1)
 {
 	// DIV - Divider Register
 	io.Register("DIV", 0x04, [&]() {
-		return divValue_;
+		return GetDiv();
 	}, [&](uint8_t v) {
-		divValue_ = 0;
+		// Resets the whole divider counter, which moves the TIMA phase.
+		CatchUp();
+		divBase_ = scheduler_.GetNow();
+		ScheduleOverflow();
 	});
 
 	// TIMA - Timer Counter
 	io.Register("TIMA", 0x05, [&]() {
+		CatchUp();
 		return timaValue_;
 	}, [&](uint8_t v) {
+		CatchUp();
 		timaValue_ = v;
+		ScheduleOverflow();
 	});
 
 	// TMA - Timer Modulo
 	io.Register("TMA", 0x06, [&]() {
 		return tmaValue_;
 	}, [&](uint8_t v) {
+		CatchUp();
 		tmaValue_ = v;
 	});
 
@@ -47,11 +57,21 @@ Timer::Timer(Log &log, IO &io, Pic &pic)
 	io.Register("TAC", 0x07, [&]() {
 		return tacValue_;
 	}, [&](uint8_t v) {
+		CatchUp();
 		tacValue_ = v & 0x07;
+		ScheduleOverflow();
+	});
+
+	// Nothing is ticked per instruction. The registers are computed
+	// whenever they are accessed and a scheduler event fires when TIMA
+	// is due to overflow, so the interrupt is raised on time.
+	overflowEvent_ = scheduler_.Register([&](uint64_t deadline) {
+		CatchUp();
+		ScheduleOverflow();
 	});
 }
 
-void Timer::Tick(int ticksPassed)
+int Timer::GetTimaPeriod() const
 {
 	// CPU clock: 4.194304MHz
 	// x / 16 -> 262144 Hz
@@ -59,42 +79,86 @@ void Timer::Tick(int ticksPassed)
 	// x / 256 -> 16384 Hz
 	// x / 1024 -> 4096 Hz
 
-	divTicks_ += ticksPassed;
-	if (divTicks_ > 256) // 16384 Hz
+	switch (tacValue_ & 0x3)
 	{
-		divTicks_ = 0;
-		divValue_++;
+	default:
+	case 0: return 1024; // 4096 Hz
+	case 1: return 16; // 262144 Hz
+	case 2: return 64; // 65536 Hz
+	case 3: return 256; // 16384 Hz
 	}
+}
+
+uint8_t Timer::GetDiv() const
+{
+	// Upper byte of the 16 bit divider counter, 16384 Hz.
+	return static_cast<uint8_t>((scheduler_.GetNow() - divBase_) >> 8);
+}
+
+void Timer::CatchUp()
+{
+	const uint64_t now = scheduler_.GetNow();
 
 	if (tacValue_ & 0x4)
 	{
-		int timaOverflow = 0;
-		switch (tacValue_ & 0x3)
+		const uint64_t period = GetTimaPeriod();
+		uint64_t increments = (now - divBase_) / period - (timaUpdate_ - divBase_) / period;
+
+		const uint64_t untilOverflow = 256u - timaValue_;
+		if (increments < untilOverflow)
 		{
-		case 0: timaOverflow = 1024; break; // 4096 Hz
-		case 1: timaOverflow = 16; break; // 262144 Hz
-		case 2: timaOverflow = 64; break; // 65536 Hz
-		case 3: timaOverflow = 256; break; // 16384 Hz
+			timaValue_ += static_cast<uint8_t>(increments);
 		}
-
-		timaTicks_ += ticksPassed;
-
-		while (timaTicks_ > timaOverflow)
+		else
 		{
-			timaTicks_ -= timaOverflow;
-			timaValue_++;
-
-			log_.Peripheral("TIMA " + AsHexString(timaValue_));
+			// Reloaded from TMA on overflow, possibly several times.
+			increments = (increments - untilOverflow) % (256u - tmaValue_);
+			timaValue_ = static_cast<uint8_t>(tmaValue_ + increments);
 
-			if (!timaValue_)
-			{
-				timaValue_ = tmaValue_;
+			if (log_.PeripheralEnabled())
+				log_.Peripheral("TIMA overflow " + AsHexString(timaValue_));
 
-				// Request Int.
-				pic_.RaiseInterrupts(INT_TIMER);
-			}
+			// Request Int.
+			pic_.RaiseInterrupts(INT_TIMER);
 		}
 	}
+
+	timaUpdate_ = now;
+}
+
+void Timer::ScheduleOverflow()
+{
+	if (!(tacValue_ & 0x4))
+	{
+		scheduler_.Cancel(overflowEvent_);
+		return;
+	}
+
+	// Only valid right after CatchUp(). TIMA overflows on the
+	// (256 - TIMA)th multiple of the period the divider counter reaches.
+	const uint64_t period = GetTimaPeriod();
+	const uint64_t nextIncrement = ((timaUpdate_ - divBase_) / period + 1) * period;
+	const uint64_t increments = 256u - timaValue_;
+
+	scheduler_.Schedule(overflowEvent_, divBase_ + nextIncrement + (increments - 1) * period);
+}
+
+void Timer::SaveState(StateWriter &writer) const
+{
+	writer.Write(divBase_);
+	writer.Write(timaUpdate_);
+	writer.Write(timaValue_);
+	writer.Write(tmaValue_);
+	writer.Write(tacValue_);
+}
+
+void Timer::LoadState(StateReader &reader)
+{
+	reader.Read(divBase_);
+	reader.Read(timaUpdate_);
+	reader.Read(timaValue_);
+	reader.Read(tmaValue_);
+	reader.Read(tacValue_);
 }
 
 }
\ No newline at end of file
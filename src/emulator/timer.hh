@@ -8,26 +8,41 @@ namespace GBEmu::Emulator
 class Log;
 class IO;
 class Pic;
+class Scheduler;
+class StateWriter;
+class StateReader;
 
 class Timer
 {
 public:
-	Timer(Log &log, IO &io, Pic &pic);
+	Timer(Log &log, IO &io, Pic &pic, Scheduler &scheduler);
 
-	void Tick(int ticksPassed);
+	void SaveState(StateWriter &writer) const;
+	void LoadState(StateReader &reader);
 
 private:
+	uint8_t GetDiv() const;
+	void CatchUp();
+	void ScheduleOverflow();
+	int GetTimaPeriod() const;
+
 	Log & log_;
 	IO & io_;
 	Pic & pic_;
+	Scheduler & scheduler_;
+
+	// DIV and TIMA are not counted, they are derived from the cycle
+	// counter: the divider counter is the number of cycles since divBase_,
+	// TIMA holds timaValue_ as of timaUpdate_ and advances whenever the
+	// divider counter passes a multiple of the TIMA period.
+	uint64_t divBase_;
+	uint64_t timaUpdate_;
 
-	uint8_t divValue_;
 	uint8_t timaValue_;
 	uint8_t tmaValue_;
 	uint8_t tacValue_;
 
-	int divTicks_;
-	int timaTicks_;
+	int overflowEvent_;
 
 };
 
@@ -0,0 +1,101 @@
+#include "vram.hh"
+#include "state.hh"
+
+#include <cassert>
+#include <cstring>
+
+namespace GBEmu::Emulator
+{
+
+namespace
+{
+
+// Decodes one bitplane byte into 8 pixels, one byte each, leftmost first:
+//   indices = decode[lo] | decode[hi] << 1
+// Every byte holds 0 or 1, so the shift never carries into the next pixel.
+std::array<uint64_t, 256> MakeTileRowDecodeTable()
+{
+	std::array<uint64_t, 256> table = {};
+
+	for (int b = 0; b < 256; b++)
+	{
+		uint8_t pixels[8];
+		for (int x = 0; x < 8; x++)
+			pixels[x] = (b >> (7 - x)) & 1;
+		memcpy(&table[b], pixels, 8);
+	}
+
+	return table;
+}
+
+const std::array<uint64_t, 256> tileRowDecodeTable = MakeTileRowDecodeTable();
+
+}
+
+Vram::Vram()
+	:memory_({}),
+	tiles_({}),
+	dirty_({})
+{
+	InvalidateAll();
+}
+
+uint8_t Vram::Read(uint16_t offset)
+{
+	assert(offset < size_);
+	return memory_[offset];
+}
+
+void Vram::Write(uint16_t offset, uint8_t data)
+{
+	assert(offset < size_);
+	memory_[offset] = data;
+
+	if (offset < tileDataSize_)
+	{
+		const uint16_t tile = offset / 16;
+		dirty_[tile / 64] |= uint64_t(1) << (tile % 64);
+	}
+}
+
+uint8_t *Vram::GetWritePage(uint16_t offset)
+{
+	// Tile data must go through Write() to invalidate the cache.
+	if (offset < tileDataSize_) return nullptr;
+
+	return &memory_[offset];
+}
+
+void Vram::DecodeTile(uint16_t tile)
+{
+	const uint8_t *data = &memory_[tile * 16];
+	uint8_t *out = &tiles_[tile * 64];
+
+	for (int row = 0; row < 8; row++)
+	{
+		const uint64_t indices = tileRowDecodeTable[data[row * 2]]
+			| (tileRowDecodeTable[data[row * 2 + 1]] << 1);
+		memcpy(out + row * 8, &indices, 8);
+	}
+
+	dirty_[tile / 64] &= ~(uint64_t(1) << (tile % 64));
+}
+
+void Vram::InvalidateAll()
+{
+	dirty_.fill(~uint64_t(0));
+}
+
+void Vram::SaveState(StateWriter &writer) const
+{
+	writer.Write(memory_);
+}
+
+void Vram::LoadState(StateReader &reader)
+{
+	reader.Read(memory_);
+
+	InvalidateAll();
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "memory.hh"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <array>
+
+namespace GBEmu::Emulator
+{
+
+class StateWriter;
+class StateReader;
+
+// Video RAM with a cache of the tile data decoded to one color index
+// (0..3) per byte. Writes to the tile data mark the tile dirty, it is
+// decoded again the next time it is used. The tile maps are not cached
+// and keep their direct write pages.
+class Vram : public MemoryRegion
+{
+public:
+	Vram();
+
+	virtual uint16_t GetSize() const override { return size_; }
+	virtual uint8_t Read(uint16_t offset) override;
+	virtual void Write(uint16_t offset, uint8_t data) override;
+
+	virtual uint8_t *GetReadPage(uint16_t offset) override { return &memory_[offset]; }
+	virtual uint8_t *GetWritePage(uint16_t offset) override;
+
+	const uint8_t *GetData() const { return memory_.data(); }
+
+	// Tiles 0..383 as addressed by 0x8000 + tile * 16,
+	// 8 rows of 8 color indices, leftmost pixel first.
+	static constexpr size_t tileCount_ = 384;
+	const uint8_t *GetTile(uint16_t tile)
+	{
+		assert(tile < tileCount_);
+		if (dirty_[tile / 64] & (uint64_t(1) << (tile % 64))) DecodeTile(tile);
+		return &tiles_[tile * 64];
+	}
+
+	void SaveState(StateWriter &writer) const;
+	void LoadState(StateReader &reader);
+
+private:
+	void DecodeTile(uint16_t tile);
+	void InvalidateAll();
+
+	static constexpr size_t size_ = 8 * 1024;
+	static constexpr size_t tileDataSize_ = tileCount_ * 16;
+
+	std::array<uint8_t, size_> memory_;
+	std::array<uint8_t, tileCount_ * 64> tiles_;
+	std::array<uint64_t, tileCount_ / 64> dirty_;
+};
+
+}
\ No newline at end of file
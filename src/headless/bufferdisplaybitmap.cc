@@ -0,0 +1,34 @@
+#include "bufferdisplaybitmap.hh"
+
+#include <cstdio>
+#include <cstring>
+
+namespace GBEmu
+{
+
+BufferDisplayBitmap::BufferDisplayBitmap()
+	:frame_({}),
+	frames_(0)
+{
+	frame_.fill(0xFF);
+}
+
+void BufferDisplayBitmap::SubmitFrame(const uint8_t *frame)
+{
+	memcpy(frame_.data(), frame, frame_.size());
+	frames_++;
+}
+
+bool BufferDisplayBitmap::WritePgm(const std::string &filename) const
+{
+	FILE *f = fopen(filename.c_str(), "wb");
+	if (!f) return false;
+
+	fprintf(f, "P5\n%zu %zu\n255\n", width_, height_);
+	const bool ok = fwrite(frame_.data(), 1, frame_.size(), f) == frame_.size();
+	fclose(f);
+
+	return ok;
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <string>
+
+#include "emulator/display.hh"
+
+namespace GBEmu
+{
+
+// Keeps the last presented frame in memory, one brightness byte per pixel.
+class BufferDisplayBitmap : public Emulator::DisplayBitmap
+{
+public:
+	BufferDisplayBitmap();
+
+	virtual void SubmitFrame(const uint8_t *frame) override;
+
+	static constexpr size_t width_ = 160;
+	static constexpr size_t height_ = 144;
+	using Frame = std::array<uint8_t, width_ * height_>;
+
+	const Frame &GetFrame() const { return frame_; }
+	uint64_t GetFrames() const { return frames_; }
+
+	bool WritePgm(const std::string &filename) const;
+
+private:
+	Frame frame_;
+	uint64_t frames_;
+};
+
+}
@@ -0,0 +1,381 @@
+#include "jitcheck.hh"
+#include "nulldisplaybitmap.hh"
+#include "nullsound.hh"
+#include "emulator/emulator.hh"
+#include "emulator/display.hh"
+#include "emulator/opcodes.hh"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <initializer_list>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace GBEmu
+{
+
+int CompareJit(size_t romSize, const void *romData, int frames, bool idleLoopSkipping)
+{
+	NullDisplayBitmap bitmap;
+	NullSound sound;
+
+	Emulator::Emulator jit("", romSize, romData, nullptr, bitmap, sound);
+	Emulator::Emulator interpreter("", romSize, romData, nullptr, bitmap, sound);
+	interpreter.SetJitEnabled(false);
+
+	jit.SetIdleLoopSkipping(idleLoopSkipping);
+	interpreter.SetIdleLoopSkipping(idleLoopSkipping);
+
+	std::vector<uint8_t> jitState(jit.GetStateSize());
+	std::vector<uint8_t> interpreterState(interpreter.GetStateSize());
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		// Frames of uneven length also end in the middle of blocks.
+		const uint64_t cycles = Emulator::Display::GetFrameTicks() + (frame % 5) * 1111;
+		jit.RunCycles(cycles);
+		interpreter.RunCycles(cycles);
+
+		jit.SaveState(jitState.data(), jitState.size());
+		interpreter.SaveState(interpreterState.data(), interpreterState.size());
+		if (memcmp(jitState.data(), interpreterState.data(), jitState.size()))
+			return frame;
+	}
+
+	return -1;
+}
+
+namespace
+{
+
+constexpr uint32_t randomPrograms_ = 16;
+
+void Put(std::vector<uint8_t> &rom, uint16_t address, std::initializer_list<uint8_t> bytes)
+{
+	for (const uint8_t byte : bytes)
+		rom[address++] = byte;
+}
+
+// 32 KB without MBC, starting at 0x150.
+std::vector<uint8_t> MakeRom()
+{
+	std::vector<uint8_t> rom(0x8000, 0);
+	Put(rom, 0x100, { 0x00, 0xC3, 0x50, 0x01 }); // NOP, JP 0x150
+	return rom;
+}
+
+// Copies a routine to the WRAM pages 0xC1-0xD0 and calls them in turn.
+// Each one increments the operand of an instruction further down its own
+// block, so the block has to be left right after the write. Between
+// calls the main loop flips an opcode of the routine through echo RAM.
+// The pages are written often enough to end up uncached, which the
+// delay loop spreads over several frames.
+std::vector<uint8_t> MakeSelfModifyingRom()
+{
+	std::vector<uint8_t> rom = MakeRom();
+
+	Put(rom, 0x150, {
+		0xF3,             // DI
+		0x31, 0xFE, 0xFF, // LD SP,0xFFFE
+		0x0E, 0xC1,       // LD C,0xC1
+		0x21, 0x00, 0x02, // 0x156: LD HL,0x200
+		0x51,             // LD D,C
+		0x1E, 0x00,       // LD E,0
+		0x06, 0x10,       // LD B,16
+		0x2A,             // 0x15E: LDI A,(HL)
+		0x12,             // LD (DE),A
+		0x13,             // INC DE
+		0x05,             // DEC B
+		0x20, 0xFA,       // JR NZ,0x15E
+		0x0C,             // INC C
+		0x79,             // LD A,C
+		0xFE, 0xD1,       // CP 0xD1
+		0x20, 0xEC,       // JR NZ,0x156
+		0x0E, 0xC1,       // 0x16A: LD C,0xC1
+		0x61,             // 0x16C: LD H,C
+		0x2E, 0x00,       // LD L,0
+		0xCD, 0x00, 0x03, // CALL 0x300
+		0x79,             // LD A,C
+		0xC6, 0x20,       // ADD A,0x20
+		0x67,             // LD H,A
+		0x2E, 0x09,       // LD L,9
+		0x7E,             // LD A,(HL)
+		0xEE, 0x01,       // XOR 1
+		0x77,             // LD (HL),A
+		0x0C,             // INC C
+		0x79,             // LD A,C
+		0xFE, 0xD1,       // CP 0xD1
+		0x20, 0xEA,       // JR NZ,0x16C
+		0x11, 0x00, 0x10, // LD DE,0x1000
+		0x1B,             // 0x185: DEC DE
+		0x7A,             // LD A,D
+		0xB3,             // OR E
+		0x20, 0xFB,       // JR NZ,0x185
+		0x18, 0xDE,       // JR 0x16A
+	});
+
+	// The routine, relative to its page in H.
+	Put(rom, 0x200, {
+		0x2E, 0x08,       // LD L,8
+		0x34,             // INC (HL)
+		0x00,             // NOP
+		0x00,             // NOP
+		0x00,             // NOP
+		0x00,             // NOP
+		0x06, 0x00,       // LD B,n
+		0x78,             // LD A,B, flipped to LD A,C
+		0x2E, 0x80,       // LD L,0x80
+		0x86,             // ADD A,(HL)
+		0x77,             // LD (HL),A
+		0xC9,             // RET
+	});
+
+	Put(rom, 0x300, { 0xE9 }); // JP (HL)
+	return rom;
+}
+
+// Runs the timer at 262144 Hz and requests its interrupt by writing IF
+// in the middle of a block, then moves the overflow by writing TIMA and
+// TAC. The blocks have to be left after each of these writes.
+std::vector<uint8_t> MakeInterruptRom()
+{
+	std::vector<uint8_t> rom = MakeRom();
+
+	// Timer interrupt, counts in HRAM.
+	Put(rom, 0x50, {
+		0xF5,             // PUSH AF
+		0xF0, 0x80,       // LDH A,(0x80)
+		0x3C,             // INC A
+		0xE0, 0x80,       // LDH (0x80),A
+		0xF1,             // POP AF
+		0xD9,             // RETI
+	});
+
+	Put(rom, 0x150, {
+		0xF3,             // DI
+		0x31, 0xFE, 0xFF, // LD SP,0xFFFE
+		0x3E, 0x04,       // LD A,4
+		0xE0, 0xFF,       // LDH (IE),A
+		0x3E, 0xF0,       // LD A,0xF0
+		0xE0, 0x06,       // LDH (TMA),A
+		0x3E, 0x05,       // LD A,5
+		0xE0, 0x07,       // LDH (TAC),A
+		0xAF,             // XOR A
+		0xE0, 0x0F,       // LDH (IF),A
+		0xFB,             // EI
+		0x04,             // 0x164: INC B
+		0x78,             // LD A,B
+		0xE6, 0x07,       // AND 7
+		0x20, 0x04,       // JR NZ,0x16E
+		0x3E, 0x04,       // LD A,4
+		0xE0, 0x0F,       // LDH (IF),A
+		0x0C,             // 0x16E: INC C
+		0xF0, 0x05,       // LDH A,(TIMA)
+		0x57,             // LD D,A
+		0x79,             // LD A,C
+		0xE6, 0x0F,       // AND 0x0F
+		0xC6, 0xF0,       // ADD A,0xF0
+		0xE0, 0x05,       // LDH (TIMA),A
+		0x1C,             // INC E
+		0x79,             // LD A,C
+		0xE6, 0x01,       // AND 1
+		0xC6, 0x05,       // ADD A,5
+		0xE0, 0x07,       // LDH (TAC),A
+		0x24,             // INC H
+		0x2C,             // INC L
+		0xC3, 0x64, 0x01, // JP 0x164
+	});
+
+	return rom;
+}
+
+// Whether a random run of instructions may contain opcode. Control flow
+// is left to the block ends, SP only changes by balanced PUSH and POP,
+// HALT and STOP could wait forever.
+bool IsRandomOpcode(uint8_t opcode)
+{
+	if (!Emulator::opcodeInfo[opcode].name)
+		return false;
+
+	switch (opcode)
+	{
+	case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+	case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: case 0xE9: // JP
+	case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: // CALL
+	case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9: // RET, RETI
+	case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+	case 0xC1: case 0xD1: case 0xE1: case 0xF1: case 0xC5: case 0xD5: case 0xE5: case 0xF5: // POP, PUSH
+	case 0x31: case 0x33: case 0x3B: case 0xE8: case 0xF9: // SP
+	case 0x10: case 0x76: // STOP, HALT
+		return false;
+
+	default:
+		return true;
+	}
+}
+
+// Blocks of random instructions, including CB and the ones the jit leaves
+// to the interpreter. They end with conditional jumps and calls, so the
+// flags decide where the program goes, to the start of a block only.
+// Reads go wherever the random pointers point, IO included.
+std::vector<uint8_t> MakeRandomRom(uint32_t seed)
+{
+	std::vector<uint8_t> rom = MakeRom();
+	std::mt19937 random(seed);
+
+	std::vector<uint8_t> opcodes;
+	for (int opcode = 0; opcode < 0x100; opcode++)
+	{
+		if (IsRandomOpcode(opcode))
+			opcodes.push_back(opcode);
+	}
+
+	// Writes only go to WRAM below the stack and to HRAM: IO writes
+	// could switch on display features that are not implemented, stray
+	// stack writes could return into the operand bytes.
+	auto page = [&]() { return uint8_t(0xC0 + random() % 0x1E); };
+	auto hram = [&]() { return uint8_t(0x80 + random() % 0x7F); };
+
+	auto emit = [&](uint16_t &pc, int count) {
+		for (int i = 0; i < count; i++)
+		{
+			const uint32_t kind = random() % 8;
+			if (kind == 0)
+			{
+				// PUSH rr, POP rr, possibly another pair.
+				rom[pc++] = 0xC5 + (random() % 4) * 0x10;
+				rom[pc++] = 0xC1 + (random() % 4) * 0x10;
+				continue;
+			}
+
+			const bool prefixed = kind < 3;
+			const uint8_t opcode = prefixed ? random() : opcodes[random() % opcodes.size()];
+
+			// Point the write at RAM first.
+			if (prefixed ? (opcode & 0x07) == 6 && (opcode < 0x40 || opcode >= 0x80) :
+				opcode == 0x22 || opcode == 0x32 || (opcode >= 0x34 && opcode <= 0x36) ||
+				(opcode >= 0x70 && opcode <= 0x77))
+				Put(rom, std::exchange(pc, pc + 2), { 0x26, page() }); // LD H,n
+			else if (!prefixed && opcode == 0x02)
+				Put(rom, std::exchange(pc, pc + 2), { 0x06, page() }); // LD B,n
+			else if (!prefixed && opcode == 0x12)
+				Put(rom, std::exchange(pc, pc + 2), { 0x16, page() }); // LD D,n
+			else if (!prefixed && opcode == 0xE2)
+				Put(rom, std::exchange(pc, pc + 2), { 0x0E, hram() }); // LD C,n
+
+			if (prefixed)
+			{
+				Put(rom, std::exchange(pc, pc + 2), { 0xCB, opcode });
+			}
+			else
+			{
+				rom[pc++] = opcode;
+				for (int operand = 0; operand < Emulator::opcodeInfo[opcode].operands; operand++)
+					rom[pc++] = random();
+
+				if (opcode == 0xE0)
+					rom[pc - 1] = hram();
+				else if (opcode == 0xEA || opcode == 0x08)
+					rom[pc - 1] = page();
+			}
+		}
+	};
+
+	// Interrupts return right away.
+	for (uint16_t vector = 0x40; vector <= 0x60; vector += 8)
+		rom[vector] = 0xD9;
+
+	// Subroutine for the calls, returns early or late.
+	const uint16_t subroutine = 0x7000;
+	uint16_t pc = subroutine;
+	emit(pc, 4);
+	rom[pc++] = 0xC0 + (random() % 4) * 0x08; // RET cc
+	emit(pc, 4);
+	rom[pc++] = 0xC9; // RET
+
+	pc = 0x150;
+	Put(rom, pc, { 0x31, 0xF0, 0xDF }); // LD SP,0xDFF0
+	pc += 3;
+
+	std::vector<uint16_t> blocks;
+	std::vector<uint16_t> jumps;
+	while (pc < 0x6F00)
+	{
+		blocks.push_back(pc);
+		emit(pc, 1 + random() % 12);
+
+		switch (random() % 3)
+		{
+		case 0: // JR cc to the next block, taken or not.
+			rom[pc++] = 0x20 + (random() % 4) * 0x08;
+			rom[pc++] = 0;
+			break;
+
+		case 1: // JP cc to any block.
+			rom[pc++] = 0xC2 + (random() % 4) * 0x08;
+			jumps.push_back(pc);
+			pc += 2;
+			break;
+
+		default: // CALL cc
+			rom[pc++] = 0xC4 + (random() % 4) * 0x08;
+			rom[pc++] = subroutine & 0xFF;
+			rom[pc++] = subroutine >> 8;
+			break;
+		}
+	}
+
+	// Start over after the last block.
+	rom[pc++] = 0xC3;
+	jumps.push_back(pc);
+
+	for (const uint16_t jump : jumps)
+	{
+		const uint16_t target = blocks[random() % blocks.size()];
+		rom[jump] = target & 0xFF;
+		rom[jump + 1] = target >> 8;
+	}
+
+	return rom;
+}
+
+}
+
+bool CheckJitPrograms(int frames)
+{
+	struct Program
+	{
+		std::string name;
+		std::vector<uint8_t> rom;
+	};
+
+	std::vector<Program> programs = {
+		{ "self-modifying code", MakeSelfModifyingRom() },
+		{ "interrupts and timer deadlines", MakeInterruptRom() },
+	};
+	for (uint32_t seed = 1; seed <= randomPrograms_; seed++)
+		programs.push_back({ "random instructions " + std::to_string(seed), MakeRandomRom(seed) });
+
+	bool ok = true;
+	for (const Program &program : programs)
+	{
+		const int frame = CompareJit(program.rom.size(), program.rom.data(), frames, true);
+		if (frame < 0)
+		{
+			printf("jit check: %s: %d frames match\n", program.name.c_str(), frames);
+		}
+		else
+		{
+			printf("jit check: %s: frame %d differs\n", program.name.c_str(), frame);
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+namespace GBEmu
+{
+
+// Runs a ROM twice side by side, once with the jit and once interpreted,
+// and compares their save states after every frame. Returns the first
+// frame whose states differ, -1 if all of them match.
+int CompareJit(size_t romSize, const void *romData, int frames, bool idleLoopSkipping);
+
+// Compares small built-in programs for what games rarely hit within a few
+// frames: code that rewrites itself and blocks left early for an
+// interrupt or a moved timer deadline. Prints one line per program,
+// returns whether all of them match.
+bool CheckJitPrograms(int frames);
+
+}
@@ -0,0 +1,164 @@
+#include "nulldisplaybitmap.hh"
+#include "bufferdisplaybitmap.hh"
+#include "nullsound.hh"
+#include "romstore.hh"
+#include "jitcheck.hh"
+#include "emulator/emulator.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+static void PrintUsage(const char *name)
+{
+	printf("usage: %s [options] <rom>\n", name);
+	printf("  --frames <n>     number of frames to run (default 3600)\n");
+	printf("  --log <file>     write the emulator log to <file>\n");
+	printf("  --dump <file>    write the last frame to <file> (PGM)\n");
+	printf("  --rewind <mb>    keep a rewind history of every frame within <mb> MB\n");
+	printf("  --run-ahead <n>  run <n> frames ahead every frame (paced like the SDL frontend)\n");
+	printf("  --no-idle-skip   interpret idle loops instead of fast-forwarding them\n");
+	printf("  --config <file>  per ROM settings, see roms/romconfig.txt\n");
+	printf("  --check-jit      compare the states with and without the jit every frame (jit builds)\n");
+	printf("  --check-jit-programs  same for built-in test programs instead of <rom> (jit builds)\n");
+}
+
+int main(int argc, char **argv)
+{
+	std::string romFileName;
+	std::string logFileName;
+	std::string dumpFileName;
+	std::string configFileName;
+	int frames = 3600;
+	int rewindBudget = 0;
+	int runAhead = 0;
+	bool idleLoopSkipping = true;
+	bool checkJit = false;
+	bool checkJitPrograms = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+
+		if (!strcmp(argv[i], "--frames") && hasValue) frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--log") && hasValue) logFileName = argv[++i];
+		else if (!strcmp(argv[i], "--dump") && hasValue) dumpFileName = argv[++i];
+		else if (!strcmp(argv[i], "--rewind") && hasValue) rewindBudget = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--run-ahead") && hasValue) runAhead = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--no-idle-skip")) idleLoopSkipping = false;
+		else if (!strcmp(argv[i], "--config") && hasValue) configFileName = argv[++i];
+		else if (!strcmp(argv[i], "--check-jit")) checkJit = true;
+		else if (!strcmp(argv[i], "--check-jit-programs")) checkJitPrograms = true;
+		else if (argv[i][0] != '-' && romFileName.empty()) romFileName = argv[i];
+		else {
+			PrintUsage(argv[0]);
+			return -1;
+		}
+	}
+
+	if ((romFileName.empty() && !checkJitPrograms) || frames < 0) {
+		PrintUsage(argv[0]);
+		return -1;
+	}
+
+	if ((checkJit || checkJitPrograms) && !GBEmu::Emulator::Emulator::IsJitAvailable()) {
+		printf("jit check: not available, build with -DGBEMU_JIT=ON\n");
+		return -1;
+	}
+
+	if (checkJitPrograms)
+		return GBEmu::CheckJitPrograms(frames) ? 0 : -1;
+
+	GBEmu::RomStore romStore;
+	if (!configFileName.empty())
+		romStore.LoadConfig(configFileName);
+
+	// Missing or broken files are reported by AddFromFile() already.
+	try {
+		romStore.AddFromFile(romFileName);
+	} catch (const std::runtime_error *error) {
+		delete error;
+		PrintUsage(argv[0]);
+		return -1;
+	}
+
+	const GBEmu::RomData *rom = romStore.GetRoms().front();
+
+	if (checkJit) {
+		const int frame = GBEmu::CompareJit(rom->size_, rom->data_, frames,
+			idleLoopSkipping && rom->idleLoopSkipping_);
+		if (frame >= 0) {
+			printf("jit check: frame %d differs\n", frame);
+			return -1;
+		}
+
+		printf("jit check: %d frames match\n", frames);
+		return 0;
+	}
+
+	// Only keep the frame around if it is going to be written out.
+	GBEmu::NullDisplayBitmap nullBitmap;
+	GBEmu::BufferDisplayBitmap bufferBitmap;
+	GBEmu::Emulator::DisplayBitmap &displayBitmap = dumpFileName.empty()
+		? static_cast<GBEmu::Emulator::DisplayBitmap&>(nullBitmap)
+		: static_cast<GBEmu::Emulator::DisplayBitmap&>(bufferBitmap);
+	GBEmu::NullSound sound;
+
+	auto emulator = std::make_unique<GBEmu::Emulator::Emulator>(logFileName,
+		rom->size_, rom->data_, nullptr, displayBitmap, sound);
+
+	emulator->SetIdleLoopSkipping(idleLoopSkipping && rom->idleLoopSkipping_);
+
+	if (rewindBudget > 0)
+		emulator->EnableRewind(1, static_cast<size_t>(rewindBudget) * 1024 * 1024);
+
+	const auto start = std::chrono::high_resolution_clock::now();
+	uint64_t ticks = 0;
+	if (runAhead > 0)
+	{
+		// Run-ahead is part of the paced Tick() path.
+		const double frameTime = GBEmu::Emulator::Display::GetFrameTicks() / 4194304.0;
+		const GBEmu::Emulator::KeypadKeys keys = {};
+
+		emulator->SetRunAhead(runAhead);
+		for (int i = 0; i < frames; i++)
+			emulator->Tick(frameTime, keys);
+		ticks = emulator->GetCycles();
+	}
+	else
+	{
+		ticks = emulator->RunFrames(frames);
+	}
+	const auto end = std::chrono::high_resolution_clock::now();
+
+	const double seconds = std::chrono::duration<double>(end - start).count();
+	const double fps = seconds > 0 ? frames / seconds : 0;
+	const double mhz = seconds > 0 ? ticks / seconds / 1e6 : 0;
+
+	printf("%d frames, %llu ticks in %.3f s: %.1f FPS (%.2fx realtime, %.2f MHz)\n",
+		frames, static_cast<unsigned long long>(ticks), seconds,
+		fps, mhz / 4.194304, mhz);
+
+	if (emulator->GetIdleLoopSkipping()) {
+		const GBEmu::Emulator::Emulator::IdleLoopStats stats = emulator->GetIdleLoopStats();
+		printf("idle loops: %llu skips, %llu cycles skipped\n",
+			static_cast<unsigned long long>(stats.skips),
+			static_cast<unsigned long long>(stats.skippedCycles));
+	}
+
+	if (rewindBudget > 0)
+		printf("rewind: %zu states, %zu bytes\n",
+			emulator->GetRewindStateCount(), emulator->GetRewindMemoryUsage());
+
+	if (!dumpFileName.empty() && !bufferBitmap.WritePgm(dumpFileName)) {
+		printf("unable to write frame to '%s'\n", dumpFileName.c_str());
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+#include "emulator/display.hh"
+
+namespace GBEmu
+{
+
+// Discards all pixels, only counts presented frames.
+class NullDisplayBitmap : public Emulator::DisplayBitmap
+{
+public:
+	virtual void SubmitFrame(const uint8_t *frame) override { frames_++; }
+
+	uint64_t GetFrames() const { return frames_; }
+
+private:
+	uint64_t frames_ = 0;
+};
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+#include "emulator/sound.hh"
+
+namespace GBEmu
+{
+
+// Sound device without output. Reports a sample rate of 0 so the
+// emulator does not run an audio sample clock at all.
+class NullSound : public Emulator::SoundDevice
+{
+public:
+	virtual void SetFrequency1(int freq)       override { }
+	virtual void SetVolume1(int volume)        override { }
+	virtual void SetFrequency2(int freq)       override { }
+	virtual void SetVolume2(int volume)        override { }
+	virtual void SetFrequency3(int freq)       override { }
+	virtual void SetVolume3(int volume)        override { }
+	virtual void SetPattern3(uint8_t *pattern) override { }
+	virtual void SetPlayback3(bool playback)   override { }
+	virtual void SetFrequency4(int freq)       override { }
+	virtual void SetVolume4(int volume)        override { }
+	virtual void SetWidth4(bool shortWidth)    override { }
+	virtual void Restart4()                    override { }
+
+	virtual void SetMixer(uint8_t volume, uint8_t routing) override { }
+
+	virtual int GetSampleRate() const override { return 0; }
+	virtual void Render(int samples) override { }
+};
+
+}
@@ -2,6 +2,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
 
 #ifdef __EMSCRIPTEN__
@@ -12,6 +13,12 @@ int main(int argc, char **argv)
 {
 	GBEmu::App *app = new GBEmu::App();
 	
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--run-ahead") && i + 1 < argc)
+			app->SetRunAhead(atoi(argv[++i]));
+	}
+
 	if (app->Initialize()) {
 		printf("App::Initialize() failed\n");
 		return -1;
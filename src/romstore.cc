@@ -7,6 +7,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <exception>
 
 namespace GBEmu
@@ -14,7 +15,8 @@ namespace GBEmu
 
 RomStore::RomStore()
     :roms_({}),
-    nextId_(1)
+    nextId_(1),
+    noIdleLoopSkipping_()
 {
 }
 
@@ -22,6 +24,32 @@ RomStore::~RomStore()
 {
 }
 
+void RomStore::LoadConfig(const std::string& filename)
+{
+    std::ifstream stream(filename);
+    if (!stream.is_open())
+        return;
+
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream fields(line);
+        std::string option, title;
+        fields >> option >> std::ws;
+        std::getline(fields, title);
+
+        if (option == "no-idle-skip" && !title.empty())
+            noIdleLoopSkipping_.insert(title);
+        else
+            printf("%s: ignoring '%s'\n", filename.c_str(), line.c_str());
+    }
+}
+
 void RomStore::AddFromFile(const std::string& filename)
 {
     // Open file.
@@ -39,24 +67,45 @@ void RomStore::AddFromFile(const std::string& filename)
 	auto endPosition = stream.tellg();
 	stream.seekg(0, std::ios_base::beg);
 
-	const size_t fileSize = size_t(endPosition - startPosition);
+	// Directories open fine, but have no size.
+	if (startPosition < 0 || endPosition <= startPosition ||
+		(endPosition - startPosition) % (32 * 1024))
+	{
+		printf("invalid rom file: %s\n", filename.c_str());
+		throw new std::runtime_error("invalid rom file");
+	}
 
-	assert(fileSize > 0);
-	assert(!(fileSize % (32 * 1024)));
+	const size_t fileSize = size_t(endPosition - startPosition);
 
 	// Read file content.
     char *data = new char[fileSize];
     assert(data);
 	stream.read(data, fileSize);
+
+	if (!stream)
+	{
+		delete[] data;
+		printf("unable to read rom file: %s\n", filename.c_str());
+		throw new std::runtime_error("unable to read rom file");
+	}
     
     // Add to store.    
     int id = nextId_++;
     std::string name = filename;
 
-    RomData *rom = new RomData(id, name, fileSize, data);
+    // Title at 0x134, up to 16 characters padded with zeros. Newer
+    // headers use the last one as a flag.
+    std::string title;
+    for (size_t i = 0x134; i < 0x144 && data[i] >= 0x20 && data[i] < 0x7F; i++)
+        title += data[i];
+
+    const bool idleLoopSkipping = !noIdleLoopSkipping_.count(title);
+
+    RomData *rom = new RomData(id, name, title, fileSize, data, idleLoopSkipping);
     roms_.push_back(rom);
 
-    printf("Added ROM from file '%s': %lu bytes\n", filename.c_str(), fileSize);
+    printf("Added ROM from file '%s': %lu bytes, title '%s'%s\n", filename.c_str(), fileSize,
+        title.c_str(), idleLoopSkipping ? "" : ", no idle loop skipping");
 }
 
 }
\ No newline at end of file
@@ -2,20 +2,25 @@
 
 #include <string>
 #include <list>
+#include <set>
 
 namespace GBEmu
 {
 
 struct RomData
 {
-    RomData(int id, std::string name, size_t size, const void *data)
-    :id_(id), name_(name), size_(size), data_(data)
+    RomData(int id, std::string name, std::string title, size_t size, const void *data, bool idleLoopSkipping)
+    :id_(id), name_(name), title_(title), size_(size), data_(data), idleLoopSkipping_(idleLoopSkipping)
     { }
 
     const int id_;
     const std::string name_;
+    const std::string title_; // From the cartridge header.
     const size_t size_;
     const void* const data_;
+
+    // Per ROM opt-out of Emulator::SetIdleLoopSkipping(), see RomStore::LoadConfig().
+    const bool idleLoopSkipping_;
 };
 
 class RomStore
@@ -24,6 +29,13 @@ public:
     RomStore();
     virtual ~RomStore();
 
+    // Per ROM settings, applied to the ROMs added afterwards. One line per
+    // setting, "<option> <title>" with the title from the cartridge
+    // header, # starts a comment. Options:
+    //   no-idle-skip  interpret idle loops instead of fast-forwarding them
+    // A missing file is not an error, all ROMs get the defaults then.
+    void LoadConfig(const std::string& filename);
+
     void AddFromFile(const std::string& filename);
 
     const std::list<const RomData*>& GetRoms() const { return roms_; };
@@ -41,6 +53,8 @@ private:
     std::list<const RomData*> roms_;
     int nextId_;
 
+    std::set<std::string> noIdleLoopSkipping_;
+
 };
 
 }
\ No newline at end of file
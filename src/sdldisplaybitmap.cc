@@ -2,6 +2,10 @@
 
 #include <cassert>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <SDL.h>
 #undef main
 
@@ -14,9 +18,7 @@ SdlDisplayBitmap::SdlDisplayBitmap(SDL_Renderer *renderer, const SDL_Rect& prese
 	width_(GBEmu::Emulator::Display::GetWidth()),
 	height_(GBEmu::Emulator::Display::GetHeight()),
 	textures_{ {nullptr, nullptr}, {nullptr, nullptr} },
-	activeTextureIndex_(0),
-	pixels_(nullptr),
-	pitch_(0)
+	activeTextureIndex_(0)
 {
 	// Assert before trying to initialize the unique_ptr.
 	assert(renderer);
@@ -35,51 +37,55 @@ SdlDisplayBitmap::SdlDisplayBitmap(SDL_Renderer *renderer, const SDL_Rect& prese
 	}
 }
 
-void SdlDisplayBitmap::Clear()
+void SdlDisplayBitmap::SubmitFrame(const uint8_t *frame)
 {
 	auto& activeTexture = textures_[activeTextureIndex_];
 
 	void *pixels = nullptr;
 	int pitch = 0;
 
-	SDL_LockTexture(activeTexture.get(), nullptr, &pixels, &pitch);
+	if (SDL_LockTexture(activeTexture.get(), nullptr, &pixels, &pitch) != 0) return;
 	assert(pixels);
-	assert(pitch);
-
-	pixels_ = reinterpret_cast<uint8_t*>(pixels);
-	pitch_ = uint16_t(pitch);
-
-	memset(pixels_, 0xFF, 4 * width_ * height_);
-}
+	assert(pitch >= width_ * 4);
 
-void SdlDisplayBitmap::DrawPixel(uint8_t x, uint8_t y, uint8_t color)
-{
-	if (x >= width_) return;
-	if (y >= height_) return;
-	if (!pixels_) return;
-
-	uint32_t offset = y * pitch_ + x * 4;
+	for (int y = 0; y < height_; y++)
+	{
+		ConvertLine(frame + y * width_,
+			reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(pixels) + y * pitch));
+	}
 
-	pixels_[offset + 0] = 255;
-	pixels_[offset + 1] = color;
-	pixels_[offset + 2] = color;
-	pixels_[offset + 3] = color;
+	SDL_UnlockTexture(activeTexture.get());
 
+	activeTextureIndex_ = (activeTextureIndex_ + 1) % 2;
 }
 
-void SdlDisplayBitmap::Present()
+// BGRA8888 is a packed format, the gray value goes to B, G and R
+// (the upper three bytes of the pixel value) and A is opaque.
+void SdlDisplayBitmap::ConvertLine(const uint8_t *shades, uint32_t *pixels)
 {
-	if (!pixels_) return;
+	int x = 0;
 
-	auto& activeTexture = textures_[activeTextureIndex_];
+#ifdef __SSE2__
+	const __m128i alpha = _mm_set1_epi32(0xFF);
 
-	SDL_UnlockTexture(activeTexture.get());
-	//SDL_RenderCopy(renderer_, texture_.get(), NULL, &presentRect_);
+	for (; x + 16 <= width_; x += 16)
+	{
+		const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(shades + x));
 
-	pixels_ = nullptr;
-	pitch_ = 0;
+		// Replicate every byte four times: c -> cccc.
+		const __m128i lo = _mm_unpacklo_epi8(s, s);
+		const __m128i hi = _mm_unpackhi_epi8(s, s);
 
-	activeTextureIndex_ = (activeTextureIndex_ + 1) % 2;
+		__m128i *out = reinterpret_cast<__m128i*>(pixels + x);
+		_mm_storeu_si128(out + 0, _mm_or_si128(_mm_unpacklo_epi16(lo, lo), alpha));
+		_mm_storeu_si128(out + 1, _mm_or_si128(_mm_unpackhi_epi16(lo, lo), alpha));
+		_mm_storeu_si128(out + 2, _mm_or_si128(_mm_unpacklo_epi16(hi, hi), alpha));
+		_mm_storeu_si128(out + 3, _mm_or_si128(_mm_unpackhi_epi16(hi, hi), alpha));
+	}
+#endif
+
+	for (; x < width_; x++)
+		pixels[x] = shades[x] * 0x01010100u | 0xFF;
 }
 
 void SdlDisplayBitmap::Render()
@@ -17,12 +17,13 @@ class SdlDisplayBitmap : public Emulator::DisplayBitmap
 public:
 	SdlDisplayBitmap(SDL_Renderer *renderer, const SDL_Rect& presentRect);
 
-	virtual void Clear() override;
-	virtual void DrawPixel(uint8_t x, uint8_t y, uint8_t color) override;
-	virtual void Present() override;
+	virtual void SubmitFrame(const uint8_t *frame) override;
 
 	void Render();
 
+private:
+	void ConvertLine(const uint8_t *shades, uint32_t *pixels);
+
 private:
 	SDL_Renderer * const renderer_;
 	const SDL_Rect presentRect_;
@@ -31,9 +32,6 @@ private:
 
 	std::unique_ptr<SDL_Texture, void(*)(SDL_Texture*)> textures_[2];
 	int activeTextureIndex_;
-
-	uint8_t *pixels_;
-	uint16_t pitch_;
 };
 
 }
\ No newline at end of file
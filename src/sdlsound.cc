@@ -5,6 +5,7 @@
 #include <cassert>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
 
 #include <SDL.h>
 #undef main
@@ -12,9 +13,67 @@
 namespace GBEmu
 {
 
+namespace
+{
+
+LfsrTable MakeLfsrTable(bool shortWidth)
+{
+	const size_t period = shortWidth ? 127 : 32767;
+
+	LfsrTable table;
+	table.output.resize(period);
+	table.run.resize(period);
+
+	uint16_t lfsr = 0x7FFF;
+	for (size_t i = 0; i < period; i++)
+	{
+		table.output[i] = ~lfsr & 1;
+
+		const uint16_t feedback = (lfsr ^ (lfsr >> 1)) & 1;
+		lfsr = (lfsr >> 1) | (feedback << 14);
+		if (shortWidth)
+			lfsr = (lfsr & ~0x40) | (feedback << 6);
+	}
+
+	// Walk backwards twice around the period to fill in the runs
+	// that wrap around its end.
+	uint8_t run = 1;
+	for (size_t n = 2 * period; n-- > 0; )
+	{
+		const size_t i = n % period;
+		const size_t next = (i + 1) % period;
+
+		run = (table.output[next] != table.output[i]) ? 1 : run + 1;
+		table.run[i] = run;
+	}
+
+	return table;
+}
+
+}
+
+const LfsrTable &GetLfsrTable(bool shortWidth)
+{
+	static const LfsrTable longTable = MakeLfsrTable(false);
+	static const LfsrTable shortTable = MakeLfsrTable(true);
+
+	return shortWidth ? shortTable : longTable;
+}
+
 SdlSound::SdlSound()
 	:deviceId_(0),
-	ticks_(0)
+	targetFill_(SampleSize * 2),
+	averageFill_(0),
+	rateAdjust_(0),
+	rateIntegral_(0),
+	outputFraction_(0),
+	renderedSamples_(0),
+	outputSamples_(0),
+	overruns_(0),
+	primed_(false),
+	underruns_(0),
+	blipBuffers_{ BlipBuffer(BlockSize), BlipBuffer(BlockSize), BlipBuffer(BlockSize), BlipBuffer(BlockSize) },
+	channelSamples_()
 {
 	// for (int i = 0; i < SDL_GetNumAudioDevices(0); i++) {
 	// 	const char *name = SDL_GetAudioDeviceName(i, 0);
@@ -24,8 +83,12 @@ SdlSound::SdlSound()
 	SDL_AudioSpec want = {}, have = {};
 
 	want.freq = SampleRate;
-	want.format = AUDIO_S8;
-	want.channels = 1;
+#ifdef GBEMU_FLOAT_AUDIO
+	want.format = AUDIO_F32SYS;
+#else
+	want.format = AUDIO_S16SYS;
+#endif
+	want.channels = 2;
 	want.samples = SampleSize;
 	want.callback = SDL_AudioCallback;
 	want.userdata = reinterpret_cast<void*>(this);
@@ -36,8 +99,11 @@ SdlSound::SdlSound()
 		return;
 	}
 
+	// Two device buffers: one being played, one ready for the next callback.
+	targetFill_ = size_t(have.samples) * 2;
+
 	// printf("Freq: %u\n", have.freq);
-	// printf("Format: %u (%u)\n", have.format, AUDIO_S8);
+	// printf("Format: %u (%u)\n", have.format, want.format);
 	// printf("Channels: %u\n", have.channels);
 	// printf("Samples: %u\n", have.samples);
 	// printf("Size: %u\n", have.size);
@@ -56,48 +122,124 @@ SdlSound::~SdlSound()
 	}
 }
 
-void SdlSound::Tick(int consumedTicks)
+void SdlSound::Render(int samples)
 {
-	const int targetTicks = 4194304 / SampleRate; // TODO magic number
+	UpdateRateControl();
+
+	renderedSamples_ += samples;
+	outputFraction_ += samples * (1.0 + rateAdjust_);
+	samples = static_cast<int>(outputFraction_);
+	outputFraction_ -= samples;
+	outputSamples_ += samples;
 
-	ticks_ += consumedTicks;
-	while (ticks_ > targetTicks)
+	while (samples > 0)
 	{
-		ticks_ -= targetTicks;
-		if (ticks_ < 0) ticks_ = 0;
-
-		// Emit audio sample.
-		auto sampleData = EmitSample();
-		if (sampleBuffer_.RemainingSpace() < 1)
-			printf("Audio buffer overrun\n");
-		sampleBuffer_.Push(sampleData);
+		const int count = std::min(samples, BlockSize);
+
+		channel1_.Render(blipBuffers_[0], count);
+		channel2_.Render(blipBuffers_[1], count);
+		channel3_.Render(blipBuffers_[2], count);
+		channel4_.Render(blipBuffers_[3], count);
+
+		for (int c = 0; c < StereoMixer::channelCount_; c++)
+			blipBuffers_[c].ReadSamples(channelSamples_[c], count);
+
+		WriteFrames(count);
+		samples -= count;
 	}
 }
 
-int8_t SdlSound::EmitSample()
+void SdlSound::SetMixer(uint8_t volume, uint8_t routing)
+{
+	mixer_.SetRouting(volume, routing);
+}
+
+void SdlSound::UpdateRateControl()
 {
-	int8_t sample = 0;
-	sample += channel1_.EmitSample();
-	sample += channel2_.EmitSample();
-	sample += channel3_.EmitSample();
-	return sample;
+	// The fill jumps with every block rendered and every callback,
+	// smooth it before steering by it.
+	const double fill = static_cast<double>(sampleBuffer_.DataSize());
+	averageFill_ += (fill - averageFill_) * 0.05;
+
+	// PI control. The proportional part reacts to the fill being off,
+	// the integral part settles on the actual clock drift so the fill
+	// returns to the target instead of staying off by the drift.
+	const double error = (double(targetFill_) - averageFill_) / double(targetFill_);
+	rateIntegral_ = std::clamp(rateIntegral_ + error * MaxRateAdjust * 0.002, -MaxRateAdjust, MaxRateAdjust);
+	rateAdjust_ = std::clamp(error * MaxRateAdjust + rateIntegral_, -MaxRateAdjust, MaxRateAdjust);
+}
+
+void SdlSound::WriteFrames(int count)
+{
+	// Mix straight into the ring, in up to two parts if it wraps.
+	int written = 0;
+
+	while (written < count)
+	{
+		size_t size = count - written;
+		OutputFrame * const frames = sampleBuffer_.GetWriteSpan(size);
+
+		if (!size) {
+			overruns_++;
+			return;
+		}
+
+		const int16_t * const channels[StereoMixer::channelCount_] = {
+			channelSamples_[0] + written,
+			channelSamples_[1] + written,
+			channelSamples_[2] + written,
+			channelSamples_[3] + written,
+		};
+
+		mixer_.Mix(channels, frames, static_cast<int>(size));
+		sampleBuffer_.Commit(size);
+
+		written += static_cast<int>(size);
+	}
+}
+
+SdlSound::Stats SdlSound::GetStats() const
+{
+	Stats stats = {};
+
+	stats.fill = sampleBuffer_.DataSize();
+	stats.averageFill = averageFill_;
+	stats.targetFill = targetFill_;
+	stats.rateAdjust = rateAdjust_;
+	stats.drift = renderedSamples_ ? double(outputSamples_) / double(renderedSamples_) - 1.0 : 0.0;
+	stats.underruns = underruns_.load(std::memory_order_relaxed);
+	stats.overruns = overruns_;
+
+	return stats;
 }
 
 void SdlSound::SDL_AudioCallback(void *userdata, uint8_t* stream_, int len)
 {
 	SdlSound * const sdlSound = reinterpret_cast<SdlSound * const>(userdata);
 	assert(sdlSound);
-	int8_t * const stream = reinterpret_cast<int8_t*>(stream_);
-	assert(stream);
-
-	if(sdlSound->sampleBuffer_.DataSize() < len * 2) {
-		//printf("Audio buffer underrun\n");
-		memset(stream, 0, len);
-		return;
+	assert(stream_);
+
+	// The ring holds frames in the device format, they are copied
+	// into the stream as they are.
+	OutputFrame * const stream = reinterpret_cast<OutputFrame*>(stream_);
+	const size_t frames = size_t(len) / sizeof(OutputFrame);
+
+	// Play silence until the target fill is reached, at the start and
+	// after running dry, so playback starts with the full margin.
+	if (!sdlSound->primed_) {
+		if (sdlSound->sampleBuffer_.DataSize() < sdlSound->targetFill_) {
+			memset(stream_, 0, len);
+			return;
+		}
+		sdlSound->primed_ = true;
 	}
 
-	for(int i=0; i<len; i++)
-		stream[i] = sdlSound->sampleBuffer_.Get();
+	const size_t count = sdlSound->sampleBuffer_.Pop(stream, frames);
+	if (count < frames) {
+		memset(stream + count, 0, (frames - count) * sizeof(OutputFrame));
+		sdlSound->underruns_.fetch_add(1, std::memory_order_relaxed);
+		sdlSound->primed_ = false;
+	}
 }
 
 }
@@ -2,43 +2,120 @@
 
 #include <cstdint>
 #include <cstddef>
-
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "blipbuffer.hh"
+#include "stereomixer.hh"
 #include "emulator/sound.hh"
 
 namespace GBEmu
 {
 
+// Wait-free ring buffer for exactly one producer thread calling Push()
+// or GetWriteSpan() / Commit() and one consumer thread calling Pop(). The indices run freely and are
+// only masked when accessing the buffer; each is written by one side only
+// and published with release / observed with acquire, so the samples are
+// visible before the index that covers them. Producer and consumer data
+// live on separate cache lines.
 template<class T, size_t size>
 class SampleRingBuffer
 {
+	static_assert(size > 0 && !(size & (size - 1)), "Size must be a power of two");
+
 public:
-	void Push(T data) {
-		buffer_[writePointer_] = data;
-		writePointer_ = (writePointer_ + 1) % size;
+	// Returns the number of samples written, less than count if full.
+	size_t Push(const T *data, size_t count) {
+		const size_t write = writeIndex_.load(std::memory_order_relaxed);
+
+		if (size - (write - readIndexCache_) < count)
+			readIndexCache_ = readIndex_.load(std::memory_order_acquire);
+
+		const size_t space = size - (write - readIndexCache_);
+		if (count > space) count = space;
+
+		const size_t offset = write & mask_;
+		const size_t first = std::min(count, size - offset);
+		memcpy(&buffer_[offset], data, first * sizeof(T));
+		memcpy(&buffer_[0], data + first, (count - first) * sizeof(T));
+
+		writeIndex_.store(write + count, std::memory_order_release);
+		return count;
 	}
 
-	T Get() {
-		T data = buffer_[readPointer_];
-		readPointer_ = (readPointer_ + 1) % size;
-		return data;
+	// In-place alternative to Push(): returns the free space at the write
+	// position, contiguous and at most count samples long, which becomes
+	// visible to the consumer with Commit(). count is 0 if full.
+	T *GetWriteSpan(size_t &count) {
+		const size_t write = writeIndex_.load(std::memory_order_relaxed);
+
+		if (size - (write - readIndexCache_) < count)
+			readIndexCache_ = readIndex_.load(std::memory_order_acquire);
+
+		const size_t offset = write & mask_;
+		const size_t space = size - (write - readIndexCache_);
+		count = std::min({ count, space, size - offset });
+
+		return &buffer_[offset];
 	}
 
-	size_t RemainingSpace() {
-		return size - DataSize();
+	void Commit(size_t count) {
+		const size_t write = writeIndex_.load(std::memory_order_relaxed);
+		assert(size - (write - readIndexCache_) >= count);
+
+		writeIndex_.store(write + count, std::memory_order_release);
+	}
+
+	// Returns the number of samples read, less than count if empty.
+	size_t Pop(T *data, size_t count) {
+		const size_t read = readIndex_.load(std::memory_order_relaxed);
+
+		if (writeIndexCache_ - read < count)
+			writeIndexCache_ = writeIndex_.load(std::memory_order_acquire);
+
+		const size_t available = writeIndexCache_ - read;
+		if (count > available) count = available;
+
+		const size_t offset = read & mask_;
+		const size_t first = std::min(count, size - offset);
+		memcpy(data, &buffer_[offset], first * sizeof(T));
+		memcpy(data + first, &buffer_[0], (count - first) * sizeof(T));
+
+		readIndex_.store(read + count, std::memory_order_release);
+		return count;
 	}
 
-	size_t DataSize() {
-		return (readPointer_ <= writePointer_)
-			? (writePointer_ - readPointer_)
-			: (size - (readPointer_ - writePointer_));
+	// Snapshots, exact only when called from the opposite side.
+	size_t DataSize() const {
+		return writeIndex_.load(std::memory_order_acquire) - readIndex_.load(std::memory_order_acquire);
+	}
+
+	size_t RemainingSpace() const {
+		return size - DataSize();
 	}
 
 private:
-	T buffer_[size] = {};
-	size_t readPointer_ = 0;
-	size_t writePointer_ = 0;
+	static constexpr size_t mask_ = size - 1;
+	static constexpr size_t cacheLineSize_ = 64;
+
+	// Producer side.
+	alignas(cacheLineSize_) std::atomic<size_t> writeIndex_ { 0 };
+	size_t readIndexCache_ = 0;
+
+	// Consumer side.
+	alignas(cacheLineSize_) std::atomic<size_t> readIndex_ { 0 };
+	size_t writeIndexCache_ = 0;
+
+	alignas(cacheLineSize_) T buffer_[size] = {};
 };
 
+// Channels render blocks of samples as level changes into a BlipBuffer,
+// at the exact fractional sample time of each waveform edge. Edge times
+// are 1/2^BlipBuffer::timeBits_ sample fixed point, relative to the
+// block start. Parameter changes take effect at the start of a block.
 template<int SampleRate>
 class SoundChannel
 {
@@ -47,6 +124,8 @@ public:
 		frequency_ = frequency;
 		if (frequency_ < 1) frequency_ = 1;
 		if (frequency_ > SampleRate / 2) frequency_ = SampleRate / 2;
+
+		halfPeriod_ = (uint64_t(SampleRate) << BlipBuffer::timeBits_) / (2 * frequency_);
 	}
 
 	void SetVolume(int volume) {
@@ -55,23 +134,34 @@ public:
 		if (volume_ > 15) volume_ = 15;
 	}
 
-	int8_t EmitSample() {
-		const int cycleLength = SampleRate / frequency_;
-		cycle_ = (cycle_ + 1) % cycleLength;
+	void Render(BlipBuffer &blip, int count) {
+		const uint64_t end = uint64_t(count) << BlipBuffer::timeBits_;
+
+		SetLevel(blip, 0);
 
-		if (volume_ <= 0)
-			return 0;
+		// Low for the first half of the period, high for the second.
+		while (nextEdge_ < end) {
+			high_ = !high_;
+			SetLevel(blip, static_cast<uint32_t>(nextEdge_));
+			nextEdge_ += halfPeriod_;
+		}
 
-		if (cycle_ < cycleLength / 2)
-			return -volume_;
-		else
-			return volume_;
+		nextEdge_ -= end;
 	}
 
 private:
+	void SetLevel(BlipBuffer &blip, uint32_t time) {
+		const int level = high_ ? volume_ : -volume_;
+		blip.AddDelta(time, level - level_);
+		level_ = level;
+	}
+
 	int frequency_ = 1;
 	int volume_ = 0;
-	int cycle_ = 0;
+	uint64_t halfPeriod_ = uint64_t(SampleRate) << BlipBuffer::timeBits_;
+	uint64_t nextEdge_ = 0;
+	bool high_ = false;
+	int level_ = 0;
 };
 
 template<int SampleRate>
@@ -82,62 +172,158 @@ public:
 		frequency_ = frequency;
 		if (frequency_ < 1) frequency_ = 1;
 		if (frequency_ > SampleRate / 2) frequency_ = SampleRate / 2;
+
+		// 32 pattern samples per period.
+		stepPeriod_ = (uint64_t(SampleRate) << BlipBuffer::timeBits_) / (32 * frequency_);
 	}
 
 	void SetVolume(int volume) {
 		volume_ = volume;
 		if (volume_ < 0) volume_ = 0;
-		if (volume_ > 15) volume_ = 15;
+		if (volume_ > 3) volume_ = 3;
 	}
 
-	void SetPattern(uint8_t *pattern) { // TODO std::array
-		for(int i=0; i<16; i++)
-			pattern_[i] = pattern[i];
+	void SetPattern(uint8_t *pattern) {
+		for(int i=0; i<16; i++) {
+			samples_[i * 2 + 0] = pattern[i] >> 4;
+			samples_[i * 2 + 1] = pattern[i] & 0xF;
+		}
 	}
 
 	void SetPlayback(bool playback) {
 		playback_ = playback;
 	}
 
-	int8_t EmitSample() {
+	void Render(BlipBuffer &blip, int count) {
 		if (!playback_) {
 			patternIndex_ = 0;
-			cycle_ = 0;
-			return 0;
+			nextStep_ = 0;
+			blip.AddDelta(0, -level_);
+			level_ = 0;
+			return;
 		}
 
-		int cycleLength = SampleRate / frequency_ / 32;
-		if (cycleLength < 1) cycleLength = 1;
-		cycle_ = (cycle_ + 1) % cycleLength;
+		const uint64_t end = uint64_t(count) << BlipBuffer::timeBits_;
 
-		if (cycle_ == 0)
-			patternIndex_ = (patternIndex_ + 1) % 32;
+		SetLevel(blip, 0);
 
-		uint8_t sample = pattern_[patternIndex_ / 2];
-		if (patternIndex_ % 2 == 0)
-			sample = sample >> 4;
-		else
-			sample = sample & 0xF;
-
-		switch(volume_)
-		{
-			default: 
-			case 0: sample = 0; break;
-			case 1: break;
-			case 2: sample >>= 1; break;
-			case 3: sample >>= 2; break;
+		while (nextStep_ < end) {
+			patternIndex_ = (patternIndex_ + 1) % 32;
+			SetLevel(blip, static_cast<uint32_t>(nextStep_));
+			nextStep_ += stepPeriod_;
 		}
 
-		return static_cast<int8_t>(sample);
+		nextStep_ -= end;
 	}
 
 private:
+	void SetLevel(BlipBuffer &blip, uint32_t time) {
+		// Volume 0 mutes, 1..3 shift the 4 bit samples by 0..2.
+		const int level = volume_ ? samples_[patternIndex_] >> (volume_ - 1) : 0;
+		blip.AddDelta(time, level - level_);
+		level_ = level;
+	}
+
 	int frequency_ = 1;
 	int volume_ = 0;
-	uint8_t pattern_[16] = {};
-	int patternIndex_ = 0;
+	uint8_t samples_[32] = {};
 	bool playback_ = false;
-	int cycle_ = 0;
+	uint64_t stepPeriod_ = (uint64_t(SampleRate) << BlipBuffer::timeBits_) / 32;
+	uint64_t nextStep_ = 0;
+	int patternIndex_ = 0;
+	int level_ = 0;
+};
+
+// One period of the noise LFSR output, starting from all ones, and per
+// position the number of clocks until the output changes. The output is
+// periodic (32767 clocks in 15 bit mode, 127 in 7 bit mode), so the
+// channel walks these tables instead of shifting the register.
+struct LfsrTable
+{
+	std::vector<uint8_t> output;
+	std::vector<uint8_t> run;
+};
+
+const LfsrTable &GetLfsrTable(bool shortWidth);
+
+template<int SampleRate>
+class NoiseSoundChannel
+{
+public:
+	void SetFrequency(int frequency) {
+		frequency_ = frequency;
+		if (frequency_ < 0) frequency_ = 0;
+		if (frequency_ > 1048576) frequency_ = 1048576;
+
+		stepPeriod_ = frequency_ ? (uint64_t(SampleRate) << BlipBuffer::timeBits_) / frequency_ : 0;
+		if (nextStep_ > stepPeriod_) nextStep_ = stepPeriod_;
+	}
+
+	void SetVolume(int volume) {
+		volume_ = volume;
+		if (volume_ < 0) volume_ = 0;
+		if (volume_ > 15) volume_ = 15;
+	}
+
+	void SetWidth(bool shortWidth) {
+		table_ = &GetLfsrTable(shortWidth);
+		position_ %= table_->output.size();
+	}
+
+	void Restart() {
+		position_ = 0;
+		nextStep_ = stepPeriod_;
+	}
+
+	void Render(BlipBuffer &blip, int count) {
+		const uint64_t end = uint64_t(count) << BlipBuffer::timeBits_;
+
+		SetLevel(blip, 0);
+
+		if (!stepPeriod_) {
+			nextStep_ = 0;
+			return;
+		}
+
+		const uint8_t * const run = table_->run.data();
+		const size_t period = table_->run.size();
+
+		// Jump from one output change to the next, the clocks in
+		// between do not change the level.
+		for (;;) {
+			const uint64_t change = nextStep_ + (run[position_] - 1) * stepPeriod_;
+
+			if (change >= end) {
+				const uint64_t steps = nextStep_ < end
+					? (end - nextStep_ + stepPeriod_ - 1) / stepPeriod_
+					: 0;
+				position_ = (position_ + steps) % period;
+				nextStep_ += steps * stepPeriod_;
+				break;
+			}
+
+			position_ = (position_ + run[position_]) % period;
+			nextStep_ = change + stepPeriod_;
+			SetLevel(blip, static_cast<uint32_t>(change));
+		}
+
+		nextStep_ -= end;
+	}
+
+private:
+	void SetLevel(BlipBuffer &blip, uint32_t time) {
+		const int level = table_->output[position_] ? volume_ : -volume_;
+		blip.AddDelta(time, level - level_);
+		level_ = level;
+	}
+
+	int frequency_ = 0;
+	int volume_ = 0;
+	const LfsrTable *table_ = &GetLfsrTable(false);
+	size_t position_ = 0;
+	uint64_t stepPeriod_ = 0;
+	uint64_t nextStep_ = 0;
+	int level_ = 0;
 };
 
 class SdlSound : public Emulator::SoundDevice
@@ -154,27 +340,89 @@ public:
 	virtual void SetVolume3(int volume)        override { channel3_.SetVolume(volume);     }
 	virtual void SetPattern3(uint8_t *pattern) override { channel3_.SetPattern(pattern);   }
 	virtual void SetPlayback3(bool playback)   override { channel3_.SetPlayback(playback); }
-
-	virtual void Tick(int consumedTicks) override;
+	virtual void SetFrequency4(int freq)       override { channel4_.SetFrequency(freq);    }
+	virtual void SetVolume4(int volume)        override { channel4_.SetVolume(volume);     }
+	virtual void SetWidth4(bool shortWidth)    override { channel4_.SetWidth(shortWidth);  }
+	virtual void Restart4()                    override { channel4_.Restart();             }
+
+	virtual void SetMixer(uint8_t volume, uint8_t routing) override;
+
+	virtual int GetSampleRate() const override { return SampleRate; }
+	virtual void Render(int samples) override;
+
+	struct Stats
+	{
+		size_t fill;          // Frames buffered right now.
+		double averageFill;   // Smoothed fill the rate control works on.
+		size_t targetFill;
+		double rateAdjust;    // Current resampling ratio - 1.
+		double drift;         // Frames output / samples rendered - 1, overall.
+		uint64_t underruns;
+		uint64_t overruns;
+	};
+
+	// Call from the emulation thread.
+	Stats GetStats() const;
 
 private:
-	int8_t EmitSample();
+	void UpdateRateControl();
+	void WriteFrames(int count);
 
 	static void SDL_AudioCallback(void *userdata, uint8_t *stream, int len);
 
 private:
+	// Interleaved stereo, 16 bit by default, or float to skip SDL's
+	// conversion on backends that mix in float.
+#ifdef GBEMU_FLOAT_AUDIO
+	using OutputFrame = StereoFrame<float>;
+#else
+	using OutputFrame = StereoFrame<int16_t>;
+#endif
+
 	constexpr static int SampleRate = 44100;
-	constexpr static int SampleSize = 4096;
-	//constexpr static int SampleSize = 16384;
+	constexpr static int SampleSize = 512;
+	//constexpr static int SampleSize = 4096;
+
+	// The emulation clock and the audio device clock drift apart. Instead
+	// of running into underruns or overruns, the number of samples output
+	// per emulated sample is adjusted by up to this much to keep the ring
+	// filled at targetFill_. The channels render that many more or fewer
+	// samples for the same emulated time, the audio is stretched or
+	// squeezed in time, its pitch stays.
+	constexpr static double MaxRateAdjust = 0.005;
 
 	uint32_t deviceId_;
-	int ticks_;
 
-	SampleRingBuffer<int8_t, SampleSize * 4> sampleBuffer_;
+	// Two device buffers, 23 ms at 512 samples. The emulator adds a whole
+	// host frame of audio at once on top of it, so the output lags by
+	// about 35 ms as measured, well above a few ms.
+	size_t targetFill_;
+
+	// Emulation thread.
+	double averageFill_;
+	double rateAdjust_;
+	double rateIntegral_;
+	double outputFraction_;
+	uint64_t renderedSamples_;
+	uint64_t outputSamples_;
+	uint64_t overruns_;
+
+	// Audio thread.
+	bool primed_;
+	std::atomic<uint64_t> underruns_;
+
+	SampleRingBuffer<OutputFrame, SampleSize * 8> sampleBuffer_;
+
+	// Every channel has its own buffer so the mixer can pan them.
+	constexpr static int BlockSize = 256;
+	BlipBuffer blipBuffers_[StereoMixer::channelCount_];
+	alignas(16) int16_t channelSamples_[StereoMixer::channelCount_][BlockSize];
+	StereoMixer mixer_;
 
 	SoundChannel<SampleRate> channel1_;
 	SoundChannel<SampleRate> channel2_;
 	PatternSoundChannel<SampleRate> channel3_;
+	NoiseSoundChannel<SampleRate> channel4_;
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include "stereomixer.hh"
+
+#include <cassert>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace GBEmu
+{
+
+namespace
+{
+
+constexpr float floatScale = 1.0f / 32768.0f;
+
+inline int16_t MixSample(const int16_t * const *channels, const int16_t *gains, int i)
+{
+	int sum = 0;
+	for (int c = 0; c < StereoMixer::channelCount_; c++)
+		sum += (channels[c][i] * gains[c]) >> 16;
+	return static_cast<int16_t>(std::clamp(sum, -32768, 32767));
+}
+
+#if defined(__SSE2__)
+
+// Left and right sums of 8 samples. Each product is at most a quarter of
+// the range, the saturating adds only matter for kernel overshoot.
+inline void MixBlock(const int16_t * const *channels, const int16_t (*gains)[StereoMixer::channelCount_],
+	int i, __m128i &left, __m128i &right)
+{
+	left = _mm_setzero_si128();
+	right = _mm_setzero_si128();
+
+	for (int c = 0; c < StereoMixer::channelCount_; c++)
+	{
+		const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(channels[c] + i));
+		left = _mm_adds_epi16(left, _mm_mulhi_epi16(samples, _mm_set1_epi16(gains[0][c])));
+		right = _mm_adds_epi16(right, _mm_mulhi_epi16(samples, _mm_set1_epi16(gains[1][c])));
+	}
+}
+
+inline __m128 ToFloat(__m128i samples)
+{
+	// Sign extend by moving into the high half and shifting back.
+	return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(samples, 16)), _mm_set1_ps(floatScale));
+}
+
+#elif defined(__ARM_NEON)
+
+inline void MixBlock(const int16_t * const *channels, const int16_t (*gains)[StereoMixer::channelCount_],
+	int i, int16x8_t &left, int16x8_t &right)
+{
+	left = vdupq_n_s16(0);
+	right = vdupq_n_s16(0);
+
+	for (int c = 0; c < StereoMixer::channelCount_; c++)
+	{
+		// vqdmulh doubles the product, so halve the gain.
+		const int16x8_t samples = vld1q_s16(channels[c] + i);
+		left = vqaddq_s16(left, vqdmulhq_n_s16(samples, gains[0][c] >> 1));
+		right = vqaddq_s16(right, vqdmulhq_n_s16(samples, gains[1][c] >> 1));
+	}
+}
+
+#endif
+
+}
+
+StereoMixer::StereoMixer()
+{
+	SetRouting(0x77, 0xF3);
+}
+
+void StereoMixer::SetRouting(uint8_t volume, uint8_t routing)
+{
+	// NR51 bits 0..3 route channels 1..4 to the right (SO1) output,
+	// bits 4..7 to the left (SO2). NR50 bits 0..2 are the right volume,
+	// bits 4..6 the left.
+	const int rightVolume = (volume & 0x07) + 1;
+	const int leftVolume = ((volume >> 4) & 0x07) + 1;
+
+	for (int c = 0; c < channelCount_; c++)
+	{
+		gains_[0][c] = (routing & (0x10 << c)) ? static_cast<int16_t>(leftVolume << 11) : 0;
+		gains_[1][c] = (routing & (0x01 << c)) ? static_cast<int16_t>(rightVolume << 11) : 0;
+	}
+}
+
+void StereoMixer::Mix(const int16_t * const *channels, StereoFrame<int16_t> *out, int count) const
+{
+	static_assert(sizeof(StereoFrame<int16_t>) == 2 * sizeof(int16_t), "Frames must be packed");
+	assert(count >= 0);
+
+	int i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i left, right;
+		MixBlock(channels, gains_, i, left, right);
+
+		__m128i * const dest = reinterpret_cast<__m128i*>(out + i);
+		_mm_storeu_si128(dest + 0, _mm_unpacklo_epi16(left, right));
+		_mm_storeu_si128(dest + 1, _mm_unpackhi_epi16(left, right));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 8 <= count; i += 8)
+	{
+		int16x8x2_t frames;
+		MixBlock(channels, gains_, i, frames.val[0], frames.val[1]);
+		vst2q_s16(reinterpret_cast<int16_t*>(out + i), frames);
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		out[i].left = MixSample(channels, gains_[0], i);
+		out[i].right = MixSample(channels, gains_[1], i);
+	}
+}
+
+void StereoMixer::Mix(const int16_t * const *channels, StereoFrame<float> *out, int count) const
+{
+	static_assert(sizeof(StereoFrame<float>) == 2 * sizeof(float), "Frames must be packed");
+	assert(count >= 0);
+
+	int i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i left, right;
+		MixBlock(channels, gains_, i, left, right);
+
+		// Interleaved 16 bit frames, each unpacked into the high halves
+		// of 32 bit lanes, gives the interleaved float frames.
+		const __m128i low = _mm_unpacklo_epi16(left, right);
+		const __m128i high = _mm_unpackhi_epi16(left, right);
+		const __m128i zero = _mm_setzero_si128();
+
+		float * const dest = reinterpret_cast<float*>(out + i);
+		_mm_storeu_ps(dest + 0, ToFloat(_mm_unpacklo_epi16(zero, low)));
+		_mm_storeu_ps(dest + 4, ToFloat(_mm_unpackhi_epi16(zero, low)));
+		_mm_storeu_ps(dest + 8, ToFloat(_mm_unpacklo_epi16(zero, high)));
+		_mm_storeu_ps(dest + 12, ToFloat(_mm_unpackhi_epi16(zero, high)));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 8 <= count; i += 8)
+	{
+		int16x8_t left, right;
+		MixBlock(channels, gains_, i, left, right);
+
+		float * const dest = reinterpret_cast<float*>(out + i);
+
+		float32x4x2_t frames;
+		frames.val[0] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(left))), floatScale);
+		frames.val[1] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(right))), floatScale);
+		vst2q_f32(dest, frames);
+
+		frames.val[0] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(left))), floatScale);
+		frames.val[1] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(right))), floatScale);
+		vst2q_f32(dest + 8, frames);
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		out[i].left = MixSample(channels, gains_[0], i) * floatScale;
+		out[i].right = MixSample(channels, gains_[1], i) * floatScale;
+	}
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+namespace GBEmu
+{
+
+template<class T>
+struct StereoFrame
+{
+	T left;
+	T right;
+};
+
+// Mixes the four channel outputs into interleaved stereo frames. Each
+// channel goes to the left and / or right side as routed by NR51, and
+// each side is scaled by its NR50 master volume. Works on whole blocks
+// with SSE2 or NEON where available.
+class StereoMixer
+{
+public:
+	static constexpr int channelCount_ = 4;
+
+	StereoMixer();
+
+	// NR50 (master volumes) and NR51 (routing) register values.
+	void SetRouting(uint8_t volume, uint8_t routing);
+
+	// Channel samples may use the full int16 range. At full master volume
+	// each channel adds a quarter of it to a side, so four cannot overflow.
+	void Mix(const int16_t * const *channels, StereoFrame<int16_t> *out, int count) const;
+	void Mix(const int16_t * const *channels, StereoFrame<float> *out, int count) const;
+
+private:
+	// Per side and channel, as high half multiplier: (sample * gain) >> 16
+	// is sample * volume / 8 / 4, with the volume 1..8. Zero if the channel
+	// is not routed to that side.
+	alignas(16) int16_t gains_[2][channelCount_];
+};
+
+}
\ No newline at end of file